@@ -1,7 +1,9 @@
 # gsv/api.py
-import os, time, uuid, argparse, threading
+import os, time, uuid, argparse, threading, hashlib
+import numpy as np
 import soundfile as sf
 from fastapi import FastAPI, HTTPException, Query
+from fastapi.responses import StreamingResponse
 from fastapi.middleware.cors import CORSMiddleware
 from fastapi.staticfiles import StaticFiles
 
@@ -37,6 +39,18 @@ def make_app(args: argparse.Namespace) -> FastAPI:
     if not (defaults["ref_text"] and defaults["ref_lang"]):
         raise RuntimeError("ref_text/ref_lang must be provided at launch.")
 
+    # HuBERT/BERT/spectrogram of the reference once, not per /speak
+    svc.reference(defaults["ref_wav"], defaults["ref_text"], defaults["ref_lang"])
+
+    # short id of the reference voice, sent with every synthesis: clients key
+    # their clause caches on it (changes with /set_ref or a new recording)
+    def voice_id(ref_wav, ref_text, ref_lang):
+        st = os.stat(ref_wav)
+        raw = f"{os.path.abspath(ref_wav)}\n{st.st_mtime_ns}\n{st.st_size}\n{ref_text}\n{ref_lang}"
+        return hashlib.sha1(raw.encode("utf-8")).hexdigest()[:16]
+
+    voice = {"id": voice_id(defaults["ref_wav"], defaults["ref_text"], defaults["ref_lang"])}
+
     synth_lock = threading.Lock()
 
     @app.get("/health")
@@ -49,6 +63,8 @@ def make_app(args: argparse.Namespace) -> FastAPI:
             "device": args.device,
             "out_dir": os.path.abspath(args.out_dir),
             "defaults": defaults,
+            "voice": voice["id"],
+            "ref_cache": svc.reference_stats(),
         }
 
     # Optional hot-swap of reference later
@@ -58,15 +74,24 @@ def make_app(args: argparse.Namespace) -> FastAPI:
         ref_lang: str = Query(None), text_lang: str = Query(None),
         basename: str = Query(None),
     ):
-        if ref_wav is not None:
-            if not os.path.exists(ref_wav):
-                raise HTTPException(400, f"not found: {ref_wav}")
-            defaults["ref_wav"] = ref_wav
-        if ref_text  is not None: defaults["ref_text"]  = ref_text
-        if ref_lang  is not None: defaults["ref_lang"]  = ref_lang
+        if ref_wav is not None and not os.path.exists(ref_wav):
+            raise HTTPException(400, f"not found: {ref_wav}")
+        new_ref = (ref_wav  if ref_wav  is not None else defaults["ref_wav"],
+                   ref_text if ref_text is not None else defaults["ref_text"],
+                   ref_lang if ref_lang is not None else defaults["ref_lang"])
+        # drop the old reference tensors and build the new ones now, so the
+        # next /speak doesn't pay for it (and a bad ref fails here, unapplied)
+        with synth_lock:
+            svc.clear_references()
+            try:
+                svc.reference(*new_ref)
+            except Exception as e:
+                raise HTTPException(400, f"reference failed: {e}")
+            defaults["ref_wav"], defaults["ref_text"], defaults["ref_lang"] = new_ref
+            voice["id"] = voice_id(*new_ref)
         if text_lang is not None: defaults["text_lang"] = text_lang
         if basename  is not None: defaults["basename"]  = basename
-        return {"ok": True, "defaults": defaults}
+        return {"ok": True, "defaults": defaults, "voice": voice["id"]}
 
     # Inference: only text (+ optional text_lang)
     @app.get("/speak")
@@ -79,7 +104,6 @@ def make_app(args: argparse.Namespace) -> FastAPI:
         basename: str = Query(None, description="Override output filename stem"),
     ):
         _text_lang = (text_lang or defaults["text_lang"]).strip()
-        _ref_wav, _ref_text, _ref_lang = defaults["ref_wav"], defaults["ref_text"], defaults["ref_lang"]
 
         stem = (basename or defaults["basename"] or "utt")
         fname = f"{stem}_{int(time.time()*1000)}_{uuid.uuid4().hex[:6]}.wav"
@@ -87,6 +111,9 @@ def make_app(args: argparse.Namespace) -> FastAPI:
 
         try:
             with synth_lock:
+                # reference and its id together: /set_ref swaps both under this lock
+                _ref_wav, _ref_text, _ref_lang = defaults["ref_wav"], defaults["ref_text"], defaults["ref_lang"]
+                _voice = voice["id"]
                 sr, wav = svc.synth(
                     _ref_wav, _ref_text, _ref_lang, text, _text_lang,
                     top_k=top_k, top_p=top_p, temperature=temperature,
@@ -102,7 +129,50 @@ def make_app(args: argparse.Namespace) -> FastAPI:
             "url": f"/audio/{fname}",
             "path": os.path.abspath(out_path),
             "text_lang": _text_lang,
+            "voice": _voice,
+        }
+
+    # Same synthesis as /speak, but no file: raw s16le mono PCM in the body,
+    # format in headers, sent in small chunks so playback can start on the
+    # first one (the client writes it straight into an audio sink)
+    PCM_CHUNK = 4096   # samples per chunk
+
+    @app.get("/speak_pcm")
+    def speak_pcm(
+        text: str = Query(..., description="Target text to synthesize"),
+        text_lang: str = Query(None, description="Override default text language"),
+        speed: float = 1.0,
+        top_k: int = 15, top_p: float = 0.6, temperature: float = 0.6,
+        sample_steps: int = 32,
+    ):
+        _text_lang = (text_lang or defaults["text_lang"]).strip()
+
+        try:
+            with synth_lock:
+                # same as /speak
+                _ref_wav, _ref_text, _ref_lang = defaults["ref_wav"], defaults["ref_text"], defaults["ref_lang"]
+                _voice = voice["id"]
+                sr, wav = svc.synth(
+                    _ref_wav, _ref_text, _ref_lang, text, _text_lang,
+                    top_k=top_k, top_p=top_p, temperature=temperature,
+                    speed=speed, sample_steps=sample_steps,
+                )
+        except Exception as e:
+            raise HTTPException(500, f"synthesis failed: {e}")
+
+        pcm = (np.clip(np.asarray(wav, dtype=np.float32), -1.0, 1.0) * 32767.0).astype("<i2")
+
+        def chunks():
+            for i in range(0, len(pcm), PCM_CHUNK):
+                yield pcm[i:i + PCM_CHUNK].tobytes()
+
+        headers = {
+            "X-Sample-Rate": str(sr),
+            "X-Channels": "1",
+            "X-Sample-Format": "s16le",
+            "X-Voice": _voice,
         }
+        return StreamingResponse(chunks(), media_type="application/octet-stream", headers=headers)
 
     return app
 
@@ -1,3 +1,7 @@
+import os, time, threading
+from collections import OrderedDict
+from dataclasses import dataclass, field
+
 import numpy as np
 import torch
 import torchaudio
@@ -18,6 +22,28 @@ try:
 except Exception:
     _HAS_SV = False
 
+REF_CACHE_SIZE = 4  # reference voices kept (set_ref can flip back and forth)
+
+@dataclass
+class RefVoice:
+    """Everything synth() needs from the reference; none of it depends on the target text."""
+    prompt_sem: torch.Tensor             # HuBERT -> extract_latent codes
+    phones: list                         # ref_text phones
+    bert: torch.Tensor                   # ref_text bert features
+    refer: torch.Tensor                  # get_spepc() spectrogram
+    sv_emb: list | None = None           # v2Pro/Plus speaker embedding
+    # v3/v4 only: encoded reference + its mel, already aligned/trimmed
+    fea_ref: torch.Tensor | None = None
+    ge: torch.Tensor | None = None
+    mel2: torch.Tensor | None = None
+    stamp: tuple = field(default=())     # (mtime, size) of ref_wav when built
+    build_ms: float = 0.0
+
+    def nbytes(self) -> int:
+        ts = [self.prompt_sem, self.bert, self.refer, self.fea_ref, self.ge, self.mel2]
+        ts += self.sv_emb or []
+        return sum(t.element_size() * t.nelement() for t in ts if isinstance(t, torch.Tensor))
+
 class TTSService:
     """
     One object that loads everything once and synthesizes repeatedly.
@@ -39,6 +65,12 @@ class TTSService:
         # v2Pro/Plus SV encoder if needed
         self.sv = _SV(device, is_half) if (_HAS_SV and self.sovits.version in {"v2Pro","v2ProPlus"}) else None
 
+        # reference-derived tensors, keyed by (ref_wav, ref_text, ref_lang)
+        self._refs: OrderedDict[tuple, RefVoice] = OrderedDict()
+        self._refs_lock = threading.Lock()
+        self._ref_hits = 0
+        self._ref_misses = 0
+
     # --- internals ---
     @torch.no_grad()
     def _encode_prompt_semantics(self, ref_wav_path: str):
@@ -56,6 +88,106 @@ class TTSService:
             return text
         return text + ("。" if lang_key != "en" else ".")
 
+    @staticmethod
+    def _lang_key(lang: str) -> str:
+        if lang not in dict_language: lang = lang.lower()
+        return dict_language.get(lang, "zh")
+
+    @staticmethod
+    def _file_stamp(path: str) -> tuple:
+        st = os.stat(path)
+        return (st.st_mtime_ns, st.st_size)
+
+    @torch.no_grad()
+    def _build_ref(self, ref_wav_path: str, prompt_text: str, prompt_lang: str) -> RefVoice:
+        t0 = time.perf_counter()
+        stamp = self._file_stamp(ref_wav_path)
+        v = self.sovits.version
+        dtype = torch.float16 if self.is_half else torch.float32
+
+        prompt_sem = self._encode_prompt_semantics(ref_wav_path)
+        phones, bert, _ = self.textfe.get_phones_and_bert(prompt_text, prompt_lang, v)
+
+        if v not in {"v3", "v4"}:
+            is_v2pro = v in {"v2Pro", "v2ProPlus"}
+            refer, audio_tensor = get_spepc(self.sovits.hps, ref_wav_path, dtype, self.device, is_v2pro)
+            sv_emb = None
+            if is_v2pro:
+                if not self.sv:
+                    raise RuntimeError("v2Pro/Plus requires 'sv' module/weights.")
+                sv_emb = [self.sv.compute_embedding3(audio_tensor)]
+            ref = RefVoice(prompt_sem, phones, bert, refer, sv_emb=sv_emb)
+        else:
+            refer, _ = get_spepc(self.sovits.hps, ref_wav_path, dtype, self.device, False)
+            pid0 = torch.LongTensor(phones).unsqueeze(0).to(self.device)
+            fea_ref, ge = self.sovits.vq_model.decode_encp(prompt_sem.unsqueeze(0), pid0, refer)
+
+            # mel from reference audio at target sr
+            ref_audio, sr_in = torchaudio.load(ref_wav_path)
+            ref_audio = ref_audio.to(self.device).float()
+            if ref_audio.shape[0] == 2:
+                ref_audio = ref_audio.mean(0, keepdim=True)
+            tgt_sr = 24000 if v == "v3" else 32000
+            if sr_in != tgt_sr:
+                ref_audio = resample(ref_audio, sr_in, tgt_sr, self.device)
+            mel2 = mel_fn_v3(ref_audio) if v == "v3" else mel_fn_v4(ref_audio)
+            mel2 = norm_spec(mel2)
+
+            # align ref features
+            T_min = min(mel2.shape[2], fea_ref.shape[2])
+            mel2 = mel2[:, :, :T_min]
+            fea_ref = fea_ref[:, :, :T_min]
+            Tref = 468 if v == "v3" else 500
+            if T_min > Tref:
+                mel2 = mel2[:, :, -Tref:]
+                fea_ref = fea_ref[:, :, -Tref:]
+            mel2 = mel2.to(dtype)
+            ref = RefVoice(prompt_sem, phones, bert, refer, fea_ref=fea_ref, ge=ge, mel2=mel2)
+
+        ref.stamp = stamp
+        ref.build_ms = (time.perf_counter() - t0) * 1000.0
+        return ref
+
+    def reference(self, ref_wav_path: str, prompt_text: str, prompt_lang: str) -> RefVoice:
+        """
+        Cached reference tensors; built on first use. Rebuilt if ref_wav
+        changed on disk since (same path, new recording).
+        """
+        prompt_lang = self._lang_key(prompt_lang)
+        prompt_text = self._ensure_sentence_final_punc(prompt_text.strip(), prompt_lang)
+        key = (os.path.abspath(ref_wav_path), prompt_text, prompt_lang)
+        with self._refs_lock:
+            ref = self._refs.get(key)
+            if ref is not None and ref.stamp == self._file_stamp(ref_wav_path):
+                self._refs.move_to_end(key)
+                self._ref_hits += 1
+                return ref
+            self._ref_misses += 1
+            ref = self._build_ref(ref_wav_path, prompt_text, prompt_lang)
+            self._refs[key] = ref
+            self._refs.move_to_end(key)
+            while len(self._refs) > REF_CACHE_SIZE:
+                self._refs.popitem(last=False)
+            return ref
+
+    def clear_references(self):
+        with self._refs_lock:
+            self._refs.clear()
+        if str(self.device).startswith("cuda"):
+            torch.cuda.empty_cache()
+
+    def reference_stats(self) -> dict:
+        with self._refs_lock:
+            return {
+                "entries": len(self._refs),
+                "capacity": REF_CACHE_SIZE,
+                "hits": self._ref_hits,
+                "misses": self._ref_misses,
+                "bytes": sum(r.nbytes() for r in self._refs.values()),
+                "keys": [{"ref_wav": k[0], "ref_text": k[1], "ref_lang": k[2],
+                          "build_ms": round(r.build_ms, 1)} for k, r in self._refs.items()],
+            }
+
     # --- public API ---
     @torch.no_grad()
     def synth(self,
@@ -75,23 +207,15 @@ class TTSService:
         Returns (sample_rate, mono float32 waveform in [-1,1]).
         """
 
-        # normalize language labels to internal keys
-        if prompt_lang not in dict_language: prompt_lang = prompt_lang.lower()
-        if text_lang   not in dict_language: text_lang   = text_lang.lower()
-        prompt_lang = dict_language.get(prompt_lang, "zh")
-        text_lang   = dict_language.get(text_lang, "zh")
-
-        # guard punctuation
-        prompt_text = self._ensure_sentence_final_punc(prompt_text.strip(), prompt_lang)
-        text        = self._ensure_sentence_final_punc(text.strip(), text_lang)
+        # reference side comes from the cache; only the target text is computed here
+        ref = self.reference(ref_wav_path, prompt_text, prompt_lang)
+        prompt_sem, phones1, bert1 = ref.prompt_sem, ref.phones, ref.bert
 
-        # prompt semantic
-        prompt_sem = self._encode_prompt_semantics(ref_wav_path)
+        text_lang = self._lang_key(text_lang)
+        text      = self._ensure_sentence_final_punc(text.strip(), text_lang)
 
-        # phones & bert
         version = self.sovits.version
-        phones1, bert1, _ = self.textfe.get_phones_and_bert(prompt_text, prompt_lang, version)
-        phones2, bert2, _ = self.textfe.get_phones_and_bert(text,        text_lang,   version)
+        phones2, bert2, _ = self.textfe.get_phones_and_bert(text, text_lang, version)
         bert = torch.cat([bert1, bert2], dim=1).unsqueeze(0).to(self.device)
         all_phoneme_ids = torch.LongTensor(phones1 + phones2).unsqueeze(0).to(self.device)
         all_phoneme_len = torch.tensor([all_phoneme_ids.shape[-1]]).to(self.device)
@@ -108,25 +232,17 @@ class TTSService:
         # ------- v1/v2/Pro/ProPlus path (SoVITS decode) -------
         if v not in {"v3", "v4"}:
             dtype = torch.float16 if self.is_half else torch.float32
-            refers = []
-            sv_emb = None
+            refers = [ref.refer]
+            sv_emb = ref.sv_emb
             is_v2pro = v in {"v2Pro", "v2ProPlus"}
 
             if extra_ref_wavs:
+                # extra timbre refs vary per call: not cached
+                refers = []
                 for p in extra_ref_wavs:
                     refer, audio_tensor = get_spepc(self.sovits.hps, p, dtype, self.device, is_v2pro)
                     refers.append(refer)
                 if is_v2pro:
-                    if not self.sv:
-                        raise RuntimeError("v2Pro/Plus requires 'sv' module/weights.")
-                    sv_emb = [self.sv.compute_embedding3(audio_tensor)]
-
-            if len(refers) == 0:
-                refer, audio_tensor = get_spepc(self.sovits.hps, ref_wav_path, dtype, self.device, is_v2pro)
-                refers = [refer]
-                if is_v2pro:
-                    if not self.sv:
-                        raise RuntimeError("v2Pro/Plus requires 'sv' module/weights.")
                     sv_emb = [self.sv.compute_embedding3(audio_tensor)]
 
             x = self.sovits.vq_model.decode(
@@ -143,40 +259,14 @@ class TTSService:
             return sr, x.astype("float32")
 
         # ------- v3/v4 path (CFM + vocoder) -------
-        # Build phoneme ids
-        pid0 = torch.LongTensor(phones1).unsqueeze(0).to(self.device)
         pid1 = torch.LongTensor(phones2).unsqueeze(0).to(self.device)
 
-        # ref enc
-        refer, _ = get_spepc(self.sovits.hps, ref_wav_path,
-                             torch.float16 if self.is_half else torch.float32,
-                             self.device, False)
-        fea_ref, ge = self.sovits.vq_model.decode_encp(prompt_sem.unsqueeze(0), pid0, refer)
-
-        # prepare mel from reference audio at target sr
-        ref_audio, sr_in = torchaudio.load(ref_wav_path)
-        ref_audio = ref_audio.to(self.device).float()
-        if ref_audio.shape[0] == 2:
-            ref_audio = ref_audio.mean(0, keepdim=True)
-        tgt_sr = 24000 if v == "v3" else 32000
-        if sr_in != tgt_sr:
-            ref_audio = resample(ref_audio, sr_in, tgt_sr, self.device)
-        mel2 = mel_fn_v3(ref_audio) if v == "v3" else mel_fn_v4(ref_audio)
-        mel2 = norm_spec(mel2)
-
-        # align ref features
-        T_min = min(mel2.shape[2], fea_ref.shape[2])
-        mel2 = mel2[:, :, :T_min]
-        fea_ref = fea_ref[:, :, :T_min]
-        # chunking constants
-        Tref   = 468 if v == "v3" else 500
+        # reference encoding + mel come from the cache (never modified in place below)
+        refer, ge = ref.refer, ref.ge
+        fea_ref, mel2 = ref.fea_ref, ref.mel2
+        T_min = mel2.shape[2]
         Tchunk = 934 if v == "v3" else 1000
-        if T_min > Tref:
-            mel2 = mel2[:, :, -Tref:]
-            fea_ref = fea_ref[:, :, -Tref:]
-            T_min = Tref
         chunk_len = Tchunk - T_min
-        mel2 = mel2.to(torch.float16 if self.is_half else torch.float32)
 
         fea_todo, ge = self.sovits.vq_model.decode_encp(pred_sem, pid1, refer, ge, speed)
         csegs = []
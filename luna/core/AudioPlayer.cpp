@@ -18,52 +18,159 @@ started(); finished(); error(QString)
 
 Hook mediaStatusChanged / playbackStateChanged to detect end, then emit finished().
 
+Queue (enqueue/closeQueue): clip N+1 is loaded into the second player while
+clip N plays, and started from clip N's EndOfMedia.
+
+PCM (pcmBegin/pcmAppend): no file/URL at all, see PcmOutput. A clip
+enqueued while the stream is still going waits until it has drained.
+
 */
 #include "AudioPlayer.h"
+#include "PcmOutput.h"
+#include "LatencyTrace.h"
 #include <QMediaPlayer>
 #include <QAudioOutput>
 
 AudioPlayer::AudioPlayer(QObject* parent) : QObject(parent) {
-  player_ = new QMediaPlayer(this);
-  audio_  = new QAudioOutput(this);
-  player_->setAudioOutput(audio_);
-  audio_->setVolume(0.8);            // ~80%
-  hookSignals();
+  for (int i = 0; i < 2; ++i) {
+    players_[i] = new QMediaPlayer(this);
+    outputs_[i] = new QAudioOutput(this);
+    players_[i]->setAudioOutput(outputs_[i]);
+    outputs_[i]->setVolume(0.8);     // ~80%
+    hookSignals(i);
+  }
+
+  pcm_ = new PcmOutput(this);
+  connect(pcm_, &PcmOutput::drained, this, [this]{
+    if (!busy_ && !queue_.isEmpty()) { startNext(); return; }   // clips waiting behind it
+    if (!open_ && !isActive()) emitFinished();
+  });
+  connect(pcm_, &PcmOutput::error, this, [this](const QString& msg){
+    stop();
+    emit error(msg);
+  });
 }
 
-void AudioPlayer::hookSignals() {
+void AudioPlayer::hookSignals(int i) {
+  QMediaPlayer* p = players_[i];
+
   // End-of-media
-  connect(player_, &QMediaPlayer::mediaStatusChanged, this,
-          [this](QMediaPlayer::MediaStatus st){
-            if (st == QMediaPlayer::EndOfMedia) emit finished();
+  connect(p, &QMediaPlayer::mediaStatusChanged, this,
+          [this, p](QMediaPlayer::MediaStatus st){
+            if (st != QMediaPlayer::EndOfMedia || p != players_[active_]) return;
+            busy_ = false;
+            emit clipFinished();
+            startNext();
           });
 
-  // Qt 6: errorChanged() has NO args; query player_->error()
-  connect(player_, &QMediaPlayer::errorChanged, this, [this](){
-    if (player_->error() != QMediaPlayer::NoError) {
-      const QString msg = player_->errorString().isEmpty()
-                        ? QStringLiteral("Audio error")
-                        : player_->errorString();
-      emit error(msg);
+  connect(p, &QMediaPlayer::playbackStateChanged, this, [this, p](QMediaPlayer::PlaybackState st){
+    if (st == QMediaPlayer::PlayingState && p == players_[active_])
+      LatencyTrace::mark(LatencyTrace::FirstSample);
+  });
+
+  // Qt 6: errorChanged() has NO args; query player error()
+  connect(p, &QMediaPlayer::errorChanged, this, [this, p](){
+    if (p->error() == QMediaPlayer::NoError) return;
+    if (p == standby() && preloaded_) {
+      // the preloaded clip is broken: drop it, keep the current one playing
+      preloaded_ = false;
+      if (!queue_.isEmpty()) queue_.removeFirst();
+      preload();
+      return;
     }
+    const QString msg = p->errorString().isEmpty()
+                      ? QStringLiteral("Audio error")
+                      : p->errorString();
+    stop();
+    emit error(msg);
   });
 }
 
 void AudioPlayer::play(const QUrl& url) {
-  player_->stop();
-  player_->setSource(url);       // supports http(s) and file://
-  player_->play();
+  stop();
+  queue_ << url;                 // supports http(s) and file://
+  startNext();
+}
+
+void AudioPlayer::enqueue(const QUrl& url) {
+  if (!url.isValid()) return;
+  open_ = true;
+  queue_ << url;
+  if (!busy_) startNext();
+  else        preload();
+}
+
+void AudioPlayer::closeQueue() {
+  if (!open_) return;
+  open_ = false;
+  if (pcm_->isActive()) { pcm_->endOfStream(); return; }   // finished() on drain
+  if (!isActive()) emitFinished();   // last clip already ended
+}
+
+bool AudioPlayer::isActive() const {
+  return busy_ || !queue_.isEmpty() || pcm_->isActive();
+}
+
+void AudioPlayer::pcmBegin(int sampleRate, int channels) {
+  open_ = true;
+  pcm_->begin(sampleRate, channels);
+}
+
+void AudioPlayer::pcmAppend(const QByteArray& pcm) {
+  LatencyTrace::mark(LatencyTrace::AudioSourceSet);
+  pcm_->append(pcm);
+}
+
+void AudioPlayer::startNext() {
+  if (queue_.isEmpty()) {
+    busy_ = false;
+    if (!open_ && !pcm_->isActive()) emitFinished();   // else: wait for the next enqueue()
+    return;
+  }
+  if (pcm_->isActive()) {                 // never over the PCM stream: drained() comes back here
+    busy_ = false;
+    preload();
+    return;
+  }
+  if (preloaded_) {
+    active_ = 1 - active_;            // standby already has queue_.first()
+    preloaded_ = false;
+    queue_.removeFirst();
+  } else {
+    players_[active_]->setSource(queue_.takeFirst());
+  }
+  busy_ = true;
+  LatencyTrace::mark(LatencyTrace::AudioSourceSet);
+  players_[active_]->play();
+  preload();
+}
+
+void AudioPlayer::emitFinished() {
+  LatencyTrace::mark(LatencyTrace::Finished);
+  emit finished();
+}
+
+void AudioPlayer::preload() {
+  if (preloaded_ || queue_.isEmpty()) return;
+  standby()->setSource(queue_.first());   // loads/buffers, doesn't play
+  preloaded_ = true;
 }
 
 void AudioPlayer::stop() {
-  player_->stop();
+  queue_.clear();
+  preloaded_ = false;
+  busy_ = false;
+  open_ = false;
+  for (auto* p : players_) p->stop();
+  pcm_->stop();
 }
 
 bool AudioPlayer::isPlaying() const {
-  return player_->playbackState() == QMediaPlayer::PlayingState;
+  return players_[active_]->playbackState() == QMediaPlayer::PlayingState || pcm_->isActive();
 }
 
 void AudioPlayer::setVolume(int percent) {
   const qreal v = qBound(0, percent, 100) / 100.0;
-  audio_->setVolume(v);
+  for (auto* o : outputs_) o->setVolume(v);
+  pcm_->setVolume(v);
 }
@@ -1,33 +1,61 @@
 // AudioPlayer.h
 
 /*
-  Wraps QMediaPlayer/QAudioOutput
+  Wraps QMediaPlayer/QAudioOutput; clip queue for clause-by-clause TTS
 */
 
 #pragma once
 #include <QObject>
+#include <QList>
 #include <QUrl>
 
 class QMediaPlayer;
 class QAudioOutput;
+class PcmOutput;
 
 class AudioPlayer : public QObject {
   Q_OBJECT
 public:
   explicit AudioPlayer(QObject* parent=nullptr);
 
-  void play(const QUrl& url);
+  void play(const QUrl& url);    // replaces anything playing/queued
   void stop();
   bool isPlaying() const;
   void setVolume(int percent);   // 0..100
 
+  // One utterance as several clips: enqueue() as they arrive (starts right
+  // away when idle), closeQueue() once the last one is in. finished() fires
+  // after the last clip of a closed queue, not when the queue runs dry early.
+  void enqueue(const QUrl& url);
+  void closeQueue();
+  bool isActive() const;
+
+  // Raw PCM path (TTS /speak_pcm): samples go straight to a QAudioSink.
+  // Part of the same utterance as enqueue(): closeQueue() ends it too.
+  // Clips enqueued meanwhile are held until the stream has drained.
+  void pcmBegin(int sampleRate, int channels);
+  void pcmAppend(const QByteArray& pcm);
+
 signals:
-  void finished();               // End of media reached
+  void finished();               // End of media reached (whole queue)
+  void clipFinished();           // one queued clip ended
   void error(const QString& msg);
 
 private:
-  QMediaPlayer*  player_ = nullptr;
-  QAudioOutput*  audio_  = nullptr;
-
-  void hookSignals();
+  // two players: the next clip is loaded into the idle one while the current
+  // one plays, so switching is a play() call instead of a load
+  QMediaPlayer*  players_[2] = { nullptr, nullptr };
+  QAudioOutput*  outputs_[2] = { nullptr, nullptr };
+  int            active_    = 0;
+  QList<QUrl>    queue_;               // not started yet (front may be preloaded)
+  bool           preloaded_ = false;   // standby player holds queue_.first()
+  bool           busy_      = false;   // active player is playing/loading a clip
+  bool           open_      = false;   // more clips may still be enqueued
+  PcmOutput*     pcm_       = nullptr;
+
+  void hookSignals(int i);
+  void startNext();
+  void preload();
+  void emitFinished();
+  QMediaPlayer* standby() const { return players_[1 - active_]; }
 };
@@ -1,42 +1,294 @@
 #include "BackendClient.h"
+#include "BackendSupervisor.h"
+#include "LatencyTrace.h"
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QNetworkReply>
 #include <QUrlQuery>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QHostAddress>
+#include <QSettings>
+#include <QUuid>
+#include <utility>
+#include "WavFile.h"
+
+// what /speak uses when we don't pass sampling params; part of the cache key
+static const QString kTtsParams =
+    QStringLiteral("speed=1;top_k=15;top_p=0.6;temperature=0.6;sample_steps=32");
+
+// clause breaks for the TTS pipeline; runs ("！？", "。」") stay together
+static const QString kClauseBreaks = QStringLiteral("。！？、「」!?");
+// shorter pieces get merged into the next clause (TTS prosody suffers on "あ、")
+static constexpr int kMinClauseChars = 4;
+
+static QString cleanClause(const QString& s) {
+  QString t = s;
+  t.remove(QChar(0x300C)).remove(QChar(0x300D));   // 「 」 aren't spoken
+  return t.trimmed();
+}
 
 BackendClient::BackendClient(QObject* parent)
   : QObject(parent),
-    nam_(new QNetworkAccessManager(this)) {}
+    nam_(new QNetworkAccessManager(this)) {
+  const qint64 mb = QSettings().value("ttsCacheMB",
+                                      TtsCache::kDefaultCapBytes / (1024 * 1024)).toLongLong();
+  ttsCache_.setCapBytes(mb * 1024 * 1024);
+  ttsCache_.load();
+
+  supervisor_ = new BackendSupervisor(nam_, this);
+  if (QSettings().value("ttsWarmup", true).toBool()) {
+    // a short line through the normal synthesis path, once per TTS start
+    QUrl warm(QStringLiteral("/speak_pcm"));
+    QUrlQuery q;
+    q.addQueryItem(QStringLiteral("text"), QString::fromUtf8("はい。"));
+    q.addQueryItem(QStringLiteral("text_lang"), textLang_);
+    warm.setQuery(q);
+    supervisor_->setWarmupPath(warm.toString(QUrl::FullyEncoded));
+  }
+  supervisor_->setUrls(llmBaseUrl_, ttsBaseUrl_);   // preconnect right away
+  // a restarted TTS server may have come back with another reference voice
+  connect(supervisor_, &BackendSupervisor::stateChanged, this,
+          [this](BackendSupervisor::Service s, BackendSupervisor::State st){
+    if (s != BackendSupervisor::Service::Tts) return;
+    if (st == BackendSupervisor::State::Down) voiceKey_.clear();   // no hits until we know
+    else if (st == BackendSupervisor::State::Up) fetchVoice();
+  });
+  newSession();
+}
 
-void BackendClient::setLlmBaseUrl(const QUrl& base) { llmBaseUrl_ = base; }
-void BackendClient::setTtsBaseUrl(const QUrl& base) { ttsBaseUrl_ = base; }
+BackendClient::~BackendClient() {
+  if (cache_ == &ttsCache_) ttsCache_.save();      // LRU ticks from hits (a shared one: its owner)
+}
+
+void BackendClient::setLlmBaseUrl(const QUrl& base) {
+  llmBaseUrl_ = base;
+  supervisor_->setUrls(llmBaseUrl_, ttsBaseUrl_);
+}
+void BackendClient::setTtsBaseUrl(const QUrl& base) {
+  ttsBaseUrl_ = base;
+  supervisor_->setUrls(llmBaseUrl_, ttsBaseUrl_);
+  voiceKey_.clear();                               // may be another server/voice
+  fetchVoice();
+}
+
+void BackendClient::fetchVoice() {
+  // the reference voice is part of the cache key; until we know it, no caching.
+  // Fetched again before every reply (/set_ref may have changed it); the id
+  // in each TTS reply corrects it too, for the clauses after that one
+  if (voiceFetching_ || ttsBaseUrl_.isEmpty()) return;
+  voiceFetching_ = true;
+  auto* rep = nam_->get(QNetworkRequest(ttsBaseUrl_.resolved(QUrl(QStringLiteral("/config")))));
+  connect(rep, &QNetworkReply::finished, this, [this, rep]{
+    rep->deleteLater();
+    voiceFetching_ = false;
+    if (rep->error() != QNetworkReply::NoError) return;
+    const QJsonObject cfg = QJsonDocument::fromJson(rep->readAll()).object();
+    const QString id = cfg.value(QStringLiteral("voice")).toString();
+    if (!id.isEmpty()) { voiceKey_ = id; return; }
+    // older server: no id, the reference itself then
+    const QJsonObject d = cfg.value(QStringLiteral("defaults")).toObject();
+    const QString wav = d.value(QStringLiteral("ref_wav")).toString();
+    if (wav.isEmpty()) return;
+    voiceKey_ = wav + QLatin1Char('\n') + d.value(QStringLiteral("ref_text")).toString()
+                    + QLatin1Char('\n') + d.value(QStringLiteral("ref_lang")).toString();
+  });
+}
+void BackendClient::newSession() {
+  setSession(QUuid::createUuid().toString(QUuid::WithoutBraces));
+}
 void BackendClient::setTextLang(const QString& l)   { textLang_   = l;   }
 
-void BackendClient::submit(const QString& userText) {
+int BackendClient::submit(const QString& userText) {
+  if (isBusy()) cancel();                          // newer message wins
+  ++requestId_;
+  resetRequest();
+  if (latencyTrace_) LatencyTrace::instance().begin(requestId_);
+  emit stageReached(requestId_, LatencyTrace::Submit);
+
+  pendingUser_ = userText;
+  fetchVoice();                                    // back long before the first clause
+  emit status(QStringLiteral("LUNA …"));
+  emit emotionAvailable("<E:thinking>");
+
+  postChat(streaming_);
+  return requestId_;
+}
+
+void BackendClient::cancel() {
+  const int id = requestId_;
+  ++requestId_;                                    // first: abort()'s finished is now stale
+  abortInflight();
+  resetRequest();
+  emit cancelled(id);
+}
+
+void BackendClient::resetRequest() {
   pendingUser_.clear();
   pendingEmotion_.clear();
   pendingSentence_.clear();
   pendingEchoText_.clear();
+  streamText_.clear();
+  streamBuf_.clear();
 
-  pendingUser_ = userText;
-  emit status(QStringLiteral("LUNA …"));
-  emit emotionAvailable("<E:thinking>");
+  clauseStart_ = clausesSent_ = nextClause_ = audioClips_ = sampleRate_ = 0;
+  llmDone_ = false;
+  pcmStarted_ = false;
+  earlyEmotion_ = false;
+  // one transport per reply: the player can't mix a PCM stream and clips.
+  // Only /speak with a remote server gives URLs; fallbacks later in a PCM
+  // reply fetch the WAV themselves, cache hits in a URL reply pass the file
+  urlReply_ = !pcmStreaming_ && !ttsIsLocal();
+  clauses_.clear();
+}
 
+QNetworkReply* BackendClient::own(QNetworkReply* rep) {
+  inflight_ << rep;
+  connect(rep, &QNetworkReply::finished, this, [this, rep]{ inflight_.removeAll(rep); });
+  return rep;
+}
+
+void BackendClient::abortInflight() {
+  // closing the connection stops the LLM stream server-side (see luna_llm/api.py)
+  const auto reps = std::exchange(inflight_, {});
+  for (const auto& rep : reps)
+    if (rep) rep->abort();                         // finished() fires, handlers drop it
+}
+
+void BackendClient::postChat(bool stream) {
+  streamBuf_.clear();
+  streamGotEvent_ = false;
 
-  QUrl url = llmBaseUrl_.resolved(QUrl(QStringLiteral("/chat")));
+  QUrl url = llmBaseUrl_.resolved(QUrl(stream ? QStringLiteral("/chat_stream")
+                                              : QStringLiteral("/chat")));
   QNetworkRequest req(url);
   req.setHeader(QNetworkRequest::ContentTypeHeader, QStringLiteral("application/json"));
-  const QJsonObject payload{{QStringLiteral("user"), userText}};
-  auto* rep = nam_->post(req, QJsonDocument(payload).toJson(QJsonDocument::Compact));
-  connect(rep, &QNetworkReply::finished, this, [this, rep]{ handleLlmReply(rep); });
+  QJsonObject payload{{QStringLiteral("user"), pendingUser_}};
+  if (!sessionId_.isEmpty()) {
+    // turn = replies we've shown; the server drops any it has beyond that
+    payload.insert(QStringLiteral("session"), sessionId_);
+    payload.insert(QStringLiteral("turn"), turn_);
+  }
+  // /chat: the server answers as soon as the emotion line is done, with the
+  // emotion in a header (older servers ignore this and answer as before)
+  if (!stream) payload.insert(QStringLiteral("early_emotion"), true);
+  auto* rep = own(nam_->post(req, QJsonDocument(payload).toJson(QJsonDocument::Compact)));
+  const int id = requestId_;
+  if (stream) {
+    connect(rep, &QNetworkReply::readyRead, this, [this, rep, id]{ handleStreamData(rep, id); });
+    connect(rep, &QNetworkReply::finished,  this, [this, rep, id]{ handleStreamFinished(rep, id); });
+  } else {
+    connect(rep, &QNetworkReply::metaDataChanged, this, [this, rep, id]{ handleLlmHeaders(rep, id); });
+    connect(rep, &QNetworkReply::finished,  this, [this, rep, id]{ handleLlmReply(rep, id); });
+  }
+}
+
+void BackendClient::handleStreamData(QNetworkReply* rep, int id) {
+  if (id != requestId_) return;                    // superseded/cancelled
+  if (rep->error() != QNetworkReply::NoError) return;   // reported from finished
+  markStage(LatencyTrace::LlmFirstByte);
+  streamBuf_ += rep->readAll();
+
+  // one JSON object per line; keep the unterminated tail for the next chunk
+  int start = 0;
+  for (int nl = streamBuf_.indexOf('\n'); nl >= 0; nl = streamBuf_.indexOf('\n', start)) {
+    const QByteArray line = streamBuf_.mid(start, nl - start).trimmed();
+    start = nl + 1;
+    if (line.isEmpty()) continue;
+    const QJsonDocument doc = QJsonDocument::fromJson(line);
+    if (!doc.isObject()) continue;
+    streamGotEvent_ = true;
+    handleStreamEvent(doc.object());
+  }
+  streamBuf_.remove(0, start);
+}
+
+void BackendClient::handleStreamEvent(const QJsonObject& ev) {
+  const QString type = ev.value(QStringLiteral("type")).toString();
+
+  if (type == QLatin1String("emotion")) {
+    // first line of the reply: change face while the sentence is still generating
+    pendingEmotion_ = ev.value(QStringLiteral("emotion")).toString();
+    if (!pendingEmotion_.trimmed().isEmpty()) {
+      emit emotionAvailable(pendingEmotion_.trimmed());
+      markStage(LatencyTrace::EmotionApplied);
+    }
+  } else if (type == QLatin1String("delta")) {
+    streamText_ += ev.value(QStringLiteral("text")).toString();
+    pendingSentence_ = streamText_;
+    emit partialText(pendingSentence_);
+    if (clauseTts_) takeClauses(false);            // TTS starts on the first clause
+  } else if (type == QLatin1String("done")) {
+    // authoritative split (same as /chat); the face was already set above
+    const QString emo = ev.value(QStringLiteral("emotion")).toString();
+    if (pendingEmotion_.isEmpty() && !emo.trimmed().isEmpty()) {
+      emit emotionAvailable(emo.trimmed());
+      markStage(LatencyTrace::EmotionApplied);
+    }
+    pendingEmotion_  = emo;
+    pendingSentence_ = ev.value(QStringLiteral("sentence")).toString();
+  }
+}
+
+void BackendClient::handleStreamFinished(QNetworkReply* rep, int id) {
+  rep->deleteLater();
+  if (id != requestId_) return;
+
+  if (rep->error() != QNetworkReply::NoError) {
+    // older LLM server without /chat_stream: use /chat from now on
+    const int code = rep->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (!streamGotEvent_ && (code == 404 || code == 405)) {
+      streaming_ = false;
+      postChat(false);
+      return;
+    }
+    supervisor_->pollNow();                        // server gone? readiness follows
+    emit error(QStringLiteral("LLM error: %1").arg(rep->errorString()));
+    if (clausesSent_ > 0) {
+      // part of it is already with TTS/playing: end the turn on what was
+      // sent, so ready() still comes once the audio is queued (Conversation
+      // goes back to Speaking, the trace closes when the audio drains)
+      pendingEchoText_ = streamText_.left(clauseStart_);
+      llmDone_ = true;
+      finishTurnIfDone();
+    }
+    return;
+  }
+
+  handleStreamData(rep, id);                       // whatever is still buffered
+  if (!streamBuf_.trimmed().isEmpty()) {           // last line without '\n'
+    const QJsonDocument doc = QJsonDocument::fromJson(streamBuf_);
+    if (doc.isObject()) handleStreamEvent(doc.object());
+    streamBuf_.clear();
+  }
+
+  if (pendingSentence_.trimmed().isEmpty()) {
+    emit error(QStringLiteral("LLM: missing 'sentence'"));
+    return;
+  }
+  pendingEchoText_ = pendingSentence_;
+  startTts();
+}
+
+void BackendClient::handleLlmHeaders(QNetworkReply* rep, int id) {
+  if (id != requestId_ || earlyEmotion_ || rep->error() != QNetworkReply::NoError) return;
+  const QByteArray h = rep->rawHeader("X-Emotion");
+  if (h.isEmpty()) return;
+  markStage(LatencyTrace::LlmFirstByte);
+  const QString emo = QUrl::fromPercentEncoding(h).trimmed();
+  if (emo.isEmpty()) return;
+  earlyEmotion_ = true;                            // the body's copy is not applied again
+  emit emotionAvailable(emo);
+  markStage(LatencyTrace::EmotionApplied);
 }
 
-void BackendClient::handleLlmReply(QNetworkReply* rep) {
+void BackendClient::handleLlmReply(QNetworkReply* rep, int id) {
   rep->deleteLater();
+  if (id != requestId_) return;
+  markStage(LatencyTrace::LlmFirstByte);  // /chat: first byte == last byte
 
   if (rep->error() != QNetworkReply::NoError) {
+    supervisor_->pollNow();                        // server gone? readiness follows
     emit error(QStringLiteral("LLM error: %1").arg(rep->errorString()));
     return;
   }
@@ -66,57 +318,269 @@ void BackendClient::handleLlmReply(QNetworkReply* rep) {
 
                
   // 🔔 Notify emotion to the sprite controller immediately
-  if (!pendingEmotion_.trimmed().isEmpty()) {
+  if (!earlyEmotion_ && !pendingEmotion_.trimmed().isEmpty()) {
     emit emotionAvailable(pendingEmotion_.trimmed());
+    markStage(LatencyTrace::EmotionApplied);
   }
  
-  emit status(QStringLiteral("… …"));
+  startTts();
+}
+
+void BackendClient::startTts() {
+  markStage(LatencyTrace::LlmDone);
+  ++turn_;                                         // the server has recorded this reply
+  // streaming already shows the text; otherwise keep the old status line
+  if (!streaming_) emit status(QStringLiteral("… …"));
+
+  if (streamText_.isEmpty()) streamText_ = pendingSentence_;   // /chat: all at once
+  takeClauses(true);
+  llmDone_ = true;                                 // after the last clause is queued
+  finishTurnIfDone();
+}
+
+void BackendClient::takeClauses(bool final) {
+  if (!clauseTts_) {                               // one request for the whole line
+    if (final) {
+      const QString all = cleanClause(streamText_);
+      if (!all.isEmpty()) requestClause(all);
+      clauseStart_ = streamText_.size();
+    }
+    return;
+  }
 
-  // Kick off TTS on the spoken line
+  for (int i = clauseStart_; i < streamText_.size(); ++i) {
+    if (!kClauseBreaks.contains(streamText_.at(i))) continue;
+    int end = i + 1;
+    while (end < streamText_.size() && kClauseBreaks.contains(streamText_.at(end))) ++end;
+    const QString c = cleanClause(streamText_.mid(clauseStart_, end - clauseStart_));
+    if (c.size() >= kMinClauseChars) { requestClause(c); clauseStart_ = end; }
+    i = end - 1;
+  }
+
+  if (final) {
+    const QString rest = cleanClause(streamText_.mid(clauseStart_));
+    if (!rest.isEmpty()) requestClause(rest);
+    clauseStart_ = streamText_.size();
+  }
+}
+
+void BackendClient::requestClause(const QString& clause) {
+  const int seq = clausesSent_++;
+  Clause& c = clauses_[seq];
+  markStage(LatencyTrace::TtsRequest);
+
+  c.text  = clause;
+  c.voice = voiceKey_;                             // until the reply says otherwise
+  if (voiceKey_.isEmpty()) fetchVoice();           // for next time
+  if (!voiceKey_.isEmpty()) {
+    const QByteArray key = TtsCache::key(clause, textLang_, voiceKey_, kTtsParams);
+    WavFile wav;
+    QString file;
+    const bool hit = urlReply_ ? cache_->lookupFile(key, &file) : cache_->lookup(key, &wav);
+    if (hit) {                                     // said this before: play it now
+      markStage(LatencyTrace::TtsResponse);
+      if (urlReply_) {
+        c.url = QUrl::fromLocalFile(file);
+      } else {
+        startPcm(wav.sampleRate, wav.channels);
+        c.pcm = wav.pcm;
+      }
+      c.done = true;
+      c.voice.clear();                             // nothing to store
+      advanceClauses();
+      return;
+    }
+  }
+  // same host: the WAV is read straight from disk, the reply is just JSON
+  if (!pcmStreaming_ || ttsIsLocal()) { requestClauseWav(clause, seq); return; }
+
+  // raw samples as they're sent: no WAV on disk, no second fetch of a URL
+  QUrl tts = ttsBaseUrl_.resolved(QUrl(QStringLiteral("/speak_pcm")));
+  QUrlQuery q;
+  q.addQueryItem(QStringLiteral("text"), clause);
+  q.addQueryItem(QStringLiteral("text_lang"), textLang_);
+  tts.setQuery(q);
+
+  auto* rep = own(nam_->get(QNetworkRequest(tts)));
+  const int id = requestId_;
+  connect(rep, &QNetworkReply::readyRead, this, [this, rep, id, seq]{
+    handlePcmData(rep, id, seq);
+  });
+  connect(rep, &QNetworkReply::finished, this, [this, rep, id, seq, clause]{
+    handlePcmFinished(rep, id, seq, clause);
+  });
+}
+
+void BackendClient::requestClauseWav(const QString& clause, int seq) {
+  // Kick off TTS on the spoken clause; the server serializes synthesis, so
+  // clause N+1 is generated while clause N plays
   QUrl tts = ttsBaseUrl_.resolved(QUrl(QStringLiteral("/speak")));
   QUrlQuery q;
-  q.addQueryItem(QStringLiteral("text"), pendingSentence_);
+  q.addQueryItem(QStringLiteral("text"), clause);
   q.addQueryItem(QStringLiteral("text_lang"), textLang_);
   tts.setQuery(q);
 
-  auto* ttsRep = nam_->get(QNetworkRequest(tts));
-  connect(ttsRep, &QNetworkReply::finished, this, [this, ttsRep]{ handleTtsReply(ttsRep); });
+  auto* ttsRep = own(nam_->get(QNetworkRequest(tts)));
+  const int id = requestId_;
+  connect(ttsRep, &QNetworkReply::finished, this, [this, ttsRep, id, seq]{
+    handleTtsReply(ttsRep, id, seq);
+  });
 }
 
-void BackendClient::handleTtsReply(QNetworkReply* rep) {
+void BackendClient::handleTtsReply(QNetworkReply* rep, int id, int seq) {
   rep->deleteLater();
+  if (id != requestId_ || !clauses_.contains(seq)) return;   // reply to an earlier message
+  markStage(LatencyTrace::TtsResponse);
 
-  BackendResult r;
-  r.echoText = pendingEchoText_;   // GUI text only
+  Clause& c = clauses_[seq];                       // url stays invalid on failure
+  if (rep->error() == QNetworkReply::NoError) {
+    QJsonParseError pe{};
+    const QJsonDocument doc = QJsonDocument::fromJson(rep->readAll(), &pe);
+    if (pe.error == QJsonParseError::NoError && doc.isObject()) {
+      const auto obj  = doc.object();
+      const QString u = obj.value(QStringLiteral("url")).toString();
+      const QString p = obj.value(QStringLiteral("path")).toString();
+      if (!sampleRate_) sampleRate_ = obj.value(QStringLiteral("sample_rate")).toInt(0);
+      noteVoice(c, obj.value(QStringLiteral("voice")).toString());
 
-  if (rep->error() != QNetworkReply::NoError) {
-    emit error(QStringLiteral("TTS error: %1").arg(rep->errorString()));
-    emit ready(r);                  // deliver text even if no audio
-    return;
+      WavFile wav;
+      if (!p.isEmpty() && ttsIsLocal() && wav.read(p)) {
+        startPcm(wav.sampleRate, wav.channels);
+        c.pcm = wav.pcm;                             // handed out below, in order
+        storeClause(c, wav.sampleRate, wav.channels, wav.pcm);
+      } else {
+        if (!p.isEmpty() && ttsIsLocal()) localAudio_ = false;   // not our disk after all
+        QUrl audio;
+        if (!u.isEmpty())      audio = resolveMaybeRelative(ttsBaseUrl_, u);
+        else if (!p.isEmpty()) audio = QUrl::fromLocalFile(p);
+        if (!urlReply_ && audio.isValid()) { fetchClauseWav(audio, seq); return; }
+        c.url = audio;
+      }
+    }
   }
+  c.done = true;
+  advanceClauses();
+}
+
+void BackendClient::fetchClauseWav(const QUrl& url, int seq) {
+  // the rest of this reply is PCM: download the clip and pass its samples on
+  auto* rep = own(nam_->get(QNetworkRequest(url)));
+  const int id = requestId_;
+  connect(rep, &QNetworkReply::finished, this, [this, rep, id, seq]{
+    rep->deleteLater();
+    if (id != requestId_ || !clauses_.contains(seq)) return;
+    Clause& c = clauses_[seq];
+    WavFile wav;
+    if (rep->error() == QNetworkReply::NoError && wav.parse(rep->readAll())) {
+      startPcm(wav.sampleRate, wav.channels);
+      c.pcm = wav.pcm;
+      storeClause(c, wav.sampleRate, wav.channels, wav.pcm);
+    }
+    c.done = true;                                 // unreadable: skipped like a failed clause
+    advanceClauses();
+  });
+}
 
+void BackendClient::handlePcmData(QNetworkReply* rep, int id, int seq) {
   const QByteArray bytes = rep->readAll();
-  QJsonParseError pe{};
-  const QJsonDocument doc = QJsonDocument::fromJson(bytes, &pe);
-  if (pe.error != QJsonParseError::NoError || !doc.isObject()) {
-    emit error(QStringLiteral("TTS: bad JSON"));
-    emit ready(r);
-    return;
+  if (id != requestId_ || !clauses_.contains(seq) || rep->error() != QNetworkReply::NoError) return;
+  if (bytes.isEmpty()) return;
+  markStage(LatencyTrace::TtsResponse);
+
+  startPcm(rep->rawHeader("X-Sample-Rate").toInt(), qMax(1, rep->rawHeader("X-Channels").toInt()));
+  Clause& c = clauses_[seq];
+  if (c.all.isEmpty()) noteVoice(c, QString::fromLatin1(rep->rawHeader("X-Voice")));
+  c.streamed = true;
+  c.pcm += bytes;
+  if (!c.voice.isEmpty()) c.all += bytes;
+  if (seq == nextClause_) advanceClauses();        // playing clause: pass through now
+}
+
+void BackendClient::handlePcmFinished(QNetworkReply* rep, int id, int seq, const QString& clause) {
+  rep->deleteLater();
+  if (id != requestId_ || !clauses_.contains(seq)) return;
+
+  if (rep->error() != QNetworkReply::NoError) {
+    // TTS server without /speak_pcm: /speak from now on (this reply stays
+    // PCM, see fetchClauseWav). Per clause: an earlier cache hit may have
+    // started the PCM stream already
+    const int code = rep->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (!clauses_[seq].streamed && (code == 404 || code == 405)) {
+      pcmStreaming_ = false;
+      requestClauseWav(clause, seq);
+      return;
+    }
+  } else {
+    handlePcmData(rep, id, seq);                 // anything not read yet
+    Clause& c = clauses_[seq];
+    storeClause(c, sampleRate_, pcmChannels_, c.all);
+    c.all.clear();
   }
+  clauses_[seq].done = true;
+  advanceClauses();
+}
+
+void BackendClient::noteVoice(Clause& c, const QString& voice) {
+  if (voice.isEmpty()) return;                     // older server: keep the /config guess
+  c.voice   = voice;
+  voiceKey_ = voice;                               // next clauses' lookups use it too
+}
 
-  const auto obj   = doc.object();
-  const bool ok    = obj.value(QStringLiteral("ok")).toBool(true);
-  const QString u  = obj.value(QStringLiteral("url")).toString();
-  const QString p  = obj.value(QStringLiteral("path")).toString();
-  r.sampleRate     = obj.value(QStringLiteral("sample_rate")).toInt(0);
+void BackendClient::storeClause(const Clause& c, int sampleRate, int channels, const QByteArray& pcm) {
+  if (c.voice.isEmpty() || pcm.isEmpty()) return;
+  cache_->store(TtsCache::key(c.text, textLang_, c.voice, kTtsParams), sampleRate, channels, pcm);
+}
 
-  if (!u.isEmpty()) r.audioUrl  = resolveMaybeRelative(ttsBaseUrl_, u);
-  if (!p.isEmpty()) r.localFile = QUrl::fromLocalFile(p);
+void BackendClient::startPcm(int sampleRate, int channels) {
+  // every clause of a reply comes from the same model: one format per reply
+  if (pcmStarted_) return;
+  pcmStarted_  = true;
+  sampleRate_  = sampleRate;
+  pcmChannels_ = channels;
+  emit pcmFormat(sampleRate, channels);
+}
+
+void BackendClient::markStage(int stage) {
+  if (latencyTrace_) LatencyTrace::mark(LatencyTrace::Stage(stage), requestId_);
+  emit stageReached(requestId_, stage);
+}
 
-  if (!ok && !r.audioUrl.isValid() && !r.localFile.isValid()) {
-    emit error(QStringLiteral("TTS: no audio"));
+bool BackendClient::ttsIsLocal() const {
+  if (!localAudio_) return false;
+  const QString host = ttsBaseUrl_.host();
+  if (host.compare(QLatin1String("localhost"), Qt::CaseInsensitive) == 0) return true;
+  const QHostAddress a(host);
+  return !a.isNull() && a.isLoopback();
+}
+
+void BackendClient::advanceClauses() {
+  // hand audio to the player strictly in reply order; a clause that is still
+  // streaming holds back the ones after it, a failed clause is skipped
+  while (clauses_.contains(nextClause_)) {
+    Clause& c = clauses_[nextClause_];
+    if (!c.pcm.isEmpty()) { emit pcmData(c.pcm); c.pcm.clear(); c.hasAudio = true; }
+    if (!c.done) break;
+    if (c.url.isValid())  { emit clauseAudio(c.url); c.hasAudio = true; }
+    if (c.hasAudio) ++audioClips_;
+    clauses_.remove(nextClause_++);
   }
+  finishTurnIfDone();
+}
+
+void BackendClient::finishTurnIfDone() {
+  if (!llmDone_ || nextClause_ < clausesSent_) return;
+
+  BackendResult r;
+  r.requestId  = requestId_;
+  r.echoText   = pendingEchoText_;   // GUI text only
+  r.sampleRate = sampleRate_;
+  r.clauses    = clausesSent_;
+  r.audioClips = audioClips_;
+  llmDone_ = false;                  // ready() once per turn
 
+  if (audioClips_ == 0 && latencyTrace_) LatencyTrace::instance().end(requestId_);   // nothing will play
+  if (clausesSent_ > 0 && audioClips_ == 0)
+    emit error(QStringLiteral("TTS: no audio"));   // deliver text even if no audio
   emit ready(r);
 }
 
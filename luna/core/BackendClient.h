@@ -2,7 +2,14 @@
 #include <QObject>
 #include <QUrl>
 #include <QString> 
+#include <QByteArray>
+#include <QMap>
+#include <QList>
+#include <QPointer>
+#include "TtsCache.h"
 class QNetworkAccessManager;
+class BackendSupervisor;
+class QJsonObject;
 class QNetworkReply;
 
 struct BackendResult {
@@ -12,12 +19,16 @@ struct BackendResult {
   QUrl    audioUrl;     // http(s) URL to audio (if provided by TTS)
   QUrl    localFile;    // file:// path, optional
   int     sampleRate = 0;
+  int     requestId  = 0;   // submit() that produced this
+  int     clauses    = 0;   // clause pipeline: TTS requests sent for this reply
+  int     audioClips = 0;   //   ... of which produced audio (already sent via clauseAudio)
 };
 
 class BackendClient : public QObject {
   Q_OBJECT
 public:
   explicit BackendClient(QObject* parent=nullptr);
+  ~BackendClient() override;
 
   // URLs
   void setLlmBaseUrl(const QUrl& base);            // e.g. http://127.0.0.1:8000
@@ -26,21 +37,83 @@ public:
 
 
   void setTextLang(const QString& lang);           // "ja"/"zh"/"en"
+  // POST /chat_stream (NDJSON, read as it arrives) instead of /chat;
+  // falls back to /chat on its own if the server doesn't have it
+  void setStreaming(bool on) { streaming_ = on; }
+  // synthesize clause by clause (at 。！？、「」) as the text arrives, instead
+  // of the whole sentence after the LLM is done
+  void setClauseTts(bool on) { clauseTts_ = on; }
+  // GET /speak_pcm and pass raw samples on as they arrive (pcmFormat/pcmData)
+  // instead of /speak's WAV file + URL; falls back on its own like streaming
+  void setPcmStreaming(bool on) { pcmStreaming_ = on; }
+  // TTS server on this machine: take /speak's `path`, map the WAV and pass
+  // its samples on via pcmData (no audio over the socket); the URL is the
+  // fallback when the file can't be read (e.g. server in a container)
+  void setLocalAudio(bool on) { localAudio_ = on; }
+
+  // clause audio cache (persistent, LRU); hits never reach the TTS server
+  TtsCache&       ttsCache()       { return *cache_; }
+  const TtsCache& ttsCache() const { return *cache_; }
+  // several clients in one process: share one cache instead of each having
+  // its own index over the same directory (not owned; outlives the client)
+  void setTtsCache(TtsCache* shared) { cache_ = shared ? shared : &ttsCache_; }
+
+  // conversation on the LLM server: history + KV cache kept there, so a
+  // follow-up only prefills the new message. A fresh id per client by
+  // default; empty = stateless (every message on its own)
+  void    setSession(const QString& id) { sessionId_ = id; turn_ = 0; }
+  void    newSession();
+  QString session() const { return sessionId_; }
+  int     turn() const    { return turn_; }       // replies completed in this session
+
+  // feed the app-wide LatencyTrace (off for several clients in one process)
+  void setLatencyTrace(bool on) { latencyTrace_ = on; }
+
+  // backend health/readiness (preconnect, /health polling, TTS warm-up)
+  BackendSupervisor* supervisor() const { return supervisor_; }
+
+  // id of the running (or last) submission; results for any other id are dropped
+  int  currentRequest() const { return requestId_; }
+  bool isBusy() const { return !inflight_.isEmpty(); }
 
 public slots:
-  void submit(const QString& userText);            // user → LLM → TTS (async chain)
+  // user → LLM → TTS (async chain); supersedes (cancels) a running one
+  int  submit(const QString& userText);
+  // abort every LLM/TTS reply of the running submission; nothing more is emitted for it
+  void cancel();
 
 signals:
   void status(const QString& s);                   // e.g., "LUNA …", "TTS …"
   void ready(const BackendResult& r);              // final payload (text + audio info)
   void error(const QString& msg);
   void emotionAvailable(const QString& token);  // ← ADD THIS
+  void partialText(const QString& sentenceSoFar);  // streaming: the line as it grows
+  void cancelled(int requestId);
+  // pipeline progress (LatencyTrace::Stage), each time the client passes one
+  void stageReached(int requestId, int stage);
+  void clauseAudio(const QUrl& audio);             // next clause's audio, in reply order
+  void pcmFormat(int sampleRate, int channels);    // once per reply, before pcmData
+  void pcmData(const QByteArray& pcm);             // s16le, in reply order
 
 private:
   QNetworkAccessManager* nam_;
+  BackendSupervisor*     supervisor_ = nullptr;
   QUrl llmBaseUrl_ { QStringLiteral("http://127.0.0.1:8000") };
   QUrl ttsBaseUrl_ { QStringLiteral("http://127.0.0.1:9880") };
   QString textLang_ { QStringLiteral("ja") };
+  bool    streaming_ = true;
+  bool    clauseTts_ = true;
+  bool    pcmStreaming_ = true;
+  bool    localAudio_   = true;
+  bool    latencyTrace_ = true;
+
+  TtsCache  ttsCache_;      // own one, unless setTtsCache()
+  TtsCache* cache_ = &ttsCache_;
+  QString  voiceKey_;       // TTS server's voice id (/config, X-Voice); empty = don't cache yet
+  bool     voiceFetching_ = false;
+
+  QString  sessionId_;
+  int      turn_ = 0;
 
   // pendings for current request
   QString pendingUser_;
@@ -48,8 +121,63 @@ private:
   QString pendingSentence_;
   QString pendingEchoText_;
 
-  void handleLlmReply(QNetworkReply* rep);
-  void handleTtsReply(QNetworkReply* rep);
+  // streaming state for the current reply
+  QByteArray streamBuf_;          // bytes after the last complete NDJSON line
+  bool       streamGotEvent_ = false;
+  QString    streamText_;         // sentence as streamed (clause offsets refer to it)
+
+  // clause pipeline for the current reply
+  int             requestId_   = 0;   // bumps per submit/cancel; stale replies are dropped
+  QList<QPointer<QNetworkReply>> inflight_;   // replies owned by requestId_
+  int             clauseStart_ = 0;   // streamText_ before this is already sent to TTS
+  int             clausesSent_ = 0;
+  int             nextClause_  = 0;   // next seq to hand to clauseAudio (keeps order)
+  int             audioClips_  = 0;
+  int             sampleRate_  = 0;
+  bool            llmDone_     = false;
+  bool            pcmStarted_  = false;   // pcmFormat sent for this reply
+  bool            urlReply_    = false;   // this reply plays clips (clauseAudio), not PCM
+  bool            earlyEmotion_ = false;  // /chat sent the emotion ahead (X-Emotion)
+  int             pcmChannels_ = 1;
+
+  struct Clause {
+    bool       done = false;
+    bool       hasAudio = false;
+    bool       streamed = false;   // /speak_pcm sent bytes for it
+    QUrl       url;          // /speak
+    QByteArray pcm;          // /speak_pcm bytes not handed out yet
+    QString    text;         // spoken text, part of the cache key
+    QString    voice;        // voice it was synthesized in (empty: don't cache)
+    QByteArray all;          // whole clause, for the cache
+  };
+  QMap<int, Clause> clauses_;         // seq -> in flight / waiting for nextClause_
+
+  QNetworkReply* own(QNetworkReply* rep);          // track for cancel(); auto-untracked
+  void abortInflight();
+  void resetRequest();
+
+  void postChat(bool stream);
+  void handleLlmHeaders(QNetworkReply* rep, int id);   // X-Emotion before the body
+  void handleLlmReply(QNetworkReply* rep, int id);
+  void handleStreamData(QNetworkReply* rep, int id);
+  void handleStreamEvent(const QJsonObject& ev);
+  void handleStreamFinished(QNetworkReply* rep, int id);
+  void startTts();                                 // LLM done: flush the last clause
+  void takeClauses(bool final);
+  void requestClause(const QString& clause);
+  void handleTtsReply(QNetworkReply* rep, int id, int seq);
+  void handlePcmData(QNetworkReply* rep, int id, int seq);
+  void handlePcmFinished(QNetworkReply* rep, int id, int seq, const QString& clause);
+  void requestClauseWav(const QString& clause, int seq);
+  void fetchClauseWav(const QUrl& url, int seq);   // PCM reply, /speak gave a URL
+  void advanceClauses();
+  bool ttsIsLocal() const;
+  void markStage(int stage);                       // LatencyTrace + stageReached
+  void fetchVoice();
+  void noteVoice(Clause& c, const QString& voice);   // the server says which voice it used
+  void storeClause(const Clause& c, int sampleRate, int channels, const QByteArray& pcm);
+  void startPcm(int sampleRate, int channels);
+  void finishTurnIfDone();
 
   static QUrl resolveMaybeRelative(const QUrl& base, const QString& maybe);
 };
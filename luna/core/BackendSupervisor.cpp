@@ -0,0 +1,116 @@
+/*
+
+BackendSupervisor
+
+The first submit() used to pay for two TCP handshakes and, on the TTS side,
+for cold CUDA kernels. Here: connectToHost() as soon as the URLs are known,
+a cheap GET /health per server (fast backoff while a server is down, a slow
+keep-alive poll once it's up, which also keeps the pooled connection warm),
+and one tiny synthesis each time the TTS server comes up.
+
+*/
+
+#include "BackendSupervisor.h"
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QTimer>
+
+static constexpr int kBackoffMinMs = 500;       // down: 0.5s, 1s, 2s ... 30s
+static constexpr int kBackoffMaxMs = 30 * 1000;
+static constexpr int kUpPollMs     = 15 * 1000; // up: keep-alive + liveness
+static constexpr int kHealthTimeoutMs = 3000;
+
+BackendSupervisor::BackendSupervisor(QNetworkAccessManager* nam, QObject* parent)
+  : QObject(parent), nam_(nam)
+{
+  for (Service s : { Service::Llm, Service::Tts }) {
+    Svc& v = svc(s);
+    v.timer = new QTimer(this);
+    v.timer->setSingleShot(true);
+    connect(v.timer, &QTimer::timeout, this, [this, s]{ poll(s); });
+  }
+}
+
+void BackendSupervisor::setUrls(const QUrl& llm, const QUrl& tts) {
+  for (Service s : { Service::Llm, Service::Tts }) {
+    Svc& v = svc(s);
+    const QUrl& base = (s == Service::Llm) ? llm : tts;
+    if (v.base == base && v.state != State::Unknown) continue;
+    v.base = base;
+    v.backoffMs = 0;
+    v.timer->stop();
+    // a /health for the old URL would land on the mismatch branch and
+    // never restart the timer; drop it and poll the new one now
+    if (v.reply) v.reply->abort();
+    setState(s, State::Unknown);
+    preconnect(base);
+    poll(s);
+  }
+}
+
+void BackendSupervisor::pollNow() {
+  for (Service s : { Service::Llm, Service::Tts })
+    if (!svc(s).polling) { svc(s).timer->stop(); poll(s); }
+}
+
+void BackendSupervisor::preconnect(const QUrl& base) {
+  if (!base.isValid() || base.host().isEmpty()) return;
+  // TCP (and TLS) setup now instead of on the first real request
+  if (base.scheme() == QLatin1String("https"))
+    nam_->connectToHostEncrypted(base.host(), quint16(base.port(443)));
+  else
+    nam_->connectToHost(base.host(), quint16(base.port(80)));
+}
+
+void BackendSupervisor::poll(Service s) {
+  Svc& v = svc(s);
+  if (!v.base.isValid() || v.polling) return;
+  v.polling = true;
+
+  QNetworkRequest req(v.base.resolved(QUrl(QStringLiteral("/health"))));
+  req.setTransferTimeout(kHealthTimeoutMs);
+  auto* rep = nam_->get(req);
+  v.reply = rep;
+  const QUrl base = v.base;
+  connect(rep, &QNetworkReply::finished, this, [this, s, rep, base]{
+    rep->deleteLater();
+    Svc& v = svc(s);
+    if (v.reply != rep) return;                     // superseded
+    v.reply = nullptr;
+    v.polling = false;
+    if (v.base != base) { poll(s); return; }        // URL changed meanwhile
+
+    if (rep->error() == QNetworkReply::NoError) {
+      v.backoffMs = 0;
+      if (v.state < State::Up) {
+        setState(s, State::Up);
+        if (s == Service::Tts) warmUp();
+      }
+      v.timer->start(kUpPollMs);
+    } else {
+      if (v.state != State::Down) setState(s, State::Down);
+      v.backoffMs = v.backoffMs ? qMin(v.backoffMs * 2, kBackoffMaxMs) : kBackoffMinMs;
+      v.timer->start(v.backoffMs);
+    }
+  });
+}
+
+void BackendSupervisor::warmUp() {
+  if (warmupPath_.isEmpty()) return;
+  // first synthesis loads/compiles kernels; do it now, not on the user's first line
+  auto* rep = nam_->get(QNetworkRequest(tts_.base.resolved(QUrl(warmupPath_))));
+  const QUrl base = tts_.base;
+  connect(rep, &QNetworkReply::finished, this, [this, rep, base]{
+    rep->deleteLater();
+    if (tts_.base == base && rep->error() == QNetworkReply::NoError && tts_.state == State::Up)
+      setState(Service::Tts, State::Warm);
+  });
+}
+
+void BackendSupervisor::setState(Service s, State st) {
+  Svc& v = svc(s);
+  if (v.state == st) return;
+  v.state = st;
+  emit stateChanged(s, st);
+}
@@ -0,0 +1,57 @@
+// BackendSupervisor.h
+
+/*
+  Preconnects to the LLM/TTS servers, polls /health with backoff, warms TTS up once
+*/
+#pragma once
+#include <QObject>
+#include <QUrl>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+class QTimer;
+
+class BackendSupervisor : public QObject {
+  Q_OBJECT
+public:
+  enum class Service { Llm, Tts };
+  enum class State   { Unknown, Down, Up, Warm };   // Warm: TTS warm-up synthesis done
+  Q_ENUM(Service)
+  Q_ENUM(State)
+
+  BackendSupervisor(QNetworkAccessManager* nam, QObject* parent=nullptr);
+
+  void setUrls(const QUrl& llm, const QUrl& tts);   // restarts supervision
+  // GET this (relative to the TTS base) once per TTS (re)start; empty = no warm-up
+  void setWarmupPath(const QString& pathAndQuery) { warmupPath_ = pathAndQuery; }
+
+  State state(Service s) const { return svc(s).state; }
+  bool  isUp(Service s) const  { return svc(s).state >= State::Up; }
+
+  void pollNow();                                   // e.g. right after a request failed
+
+signals:
+  void stateChanged(BackendSupervisor::Service s, BackendSupervisor::State st);
+
+private:
+  struct Svc {
+    QUrl    base;
+    State   state = State::Unknown;
+    int     backoffMs = 0;
+    bool    polling = false;
+    QNetworkReply* reply = nullptr;   // /health in flight, if any
+    QTimer* timer = nullptr;
+  };
+
+  QNetworkAccessManager* nam_;
+  Svc     llm_, tts_;
+  QString warmupPath_;
+
+  Svc&       svc(Service s)       { return s == Service::Llm ? llm_ : tts_; }
+  const Svc& svc(Service s) const { return s == Service::Llm ? llm_ : tts_; }
+
+  void preconnect(const QUrl& base);
+  void poll(Service s);
+  void setState(Service s, State st);
+  void warmUp();
+};
@@ -0,0 +1,119 @@
+/*
+
+Conversation
+
+MainWindow used to stitch a turn together from two ready() handlers, two
+emotionAvailable connections, gate flags and ad-hoc timers; every reply
+started playback twice and picked two faces. Now every signal becomes an
+Event, the table below decides where it leads, and MainWindow has one
+handler keyed by the state entered. Events that don't apply to the current
+state (a late finished() after Stop, an error after the text is up) are
+dropped here instead of each handler guarding against them.
+
+Tracing: QT_LOGGING_RULES="luna.conversation.debug=true" prints every
+transition and every ignored event.
+
+*/
+
+#include "Conversation.h"
+#include <QLoggingCategory>
+#include <QTimer>
+
+Q_LOGGING_CATEGORY(lcConversation, "luna.conversation", QtWarningMsg)
+
+using S = Conversation::State;
+using E = Conversation::Event;
+
+Conversation::Conversation(QObject* parent) : QObject(parent) {
+  holdTimer_ = new QTimer(this);
+  holdTimer_->setSingleShot(true);
+  connect(holdTimer_, &QTimer::timeout, this, [this]{ post(Event::HoldElapsed); });
+}
+
+bool Conversation::next(State from, Event ev, State* to) {
+  switch (ev) {
+  case E::Submit: *to = S::Thinking; return true;                        // from anywhere
+  case E::Cancel: *to = S::Idle;     return from != S::Idle;
+  case E::Reply:
+    // Holding: the text of a turn whose TTS or LLM stream failed (error() comes first)
+    *to = S::Speaking; return from == S::Thinking || from == S::Holding;
+  case E::AudioDone:
+  case E::Silent:      *to = S::Holding; return from == S::Speaking;
+  case E::Failed:      *to = S::Holding; return from == S::Thinking;
+  case E::HoldElapsed: *to = S::Idle;    return from == S::Holding;
+  }
+  return false;
+}
+
+bool Conversation::post(Event ev) {
+  State to;
+  if (dispatching_) {                 // from inside a handler: keep the order
+    queue_ << ev;
+    return next(state_, ev, &to);     // best guess; the queued run decides
+  }
+
+  bool accepted = false, first = true;
+  dispatching_ = true;
+  queue_ << ev;
+  while (!queue_.isEmpty()) {
+    const Event e = queue_.takeFirst();
+    const State from = state_;
+    const bool ok = next(from, e, &to);
+    if (first) { accepted = ok; first = false; }
+    if (!ok) {
+      qCDebug(lcConversation) << "ignored" << eventName(e) << "in" << stateName(from);
+      continue;
+    }
+    qCDebug(lcConversation) << stateName(from) << "->" << stateName(to) << "on" << eventName(e);
+    state_ = to;
+    enter(from, e);
+    emit transitioned(from, to, e);
+  }
+  dispatching_ = false;
+  return accepted;
+}
+
+void Conversation::enter(State from, Event ev) {
+  Q_UNUSED(from);
+  switch (state_) {
+  case S::Speaking:
+    sinceReply_.start();
+    holdTimer_->stop();
+    break;
+  case S::Holding: {
+    // minimum from when the text appeared; an error gets the full hold
+    const qint64 left = (ev == E::Failed || !sinceReply_.isValid())
+                      ? holdMs_ : holdMs_ - sinceReply_.elapsed();
+    holdTimer_->start(int(qMax<qint64>(0, left)));
+    break;
+  }
+  case S::Idle:
+  case S::Thinking:
+    holdTimer_->stop();
+    sinceReply_.invalidate();
+    break;
+  }
+}
+
+const char* Conversation::stateName(State s) {
+  switch (s) {
+  case S::Idle:     return "Idle";
+  case S::Thinking: return "Thinking";
+  case S::Speaking: return "Speaking";
+  case S::Holding:  return "Holding";
+  }
+  return "?";
+}
+
+const char* Conversation::eventName(Event e) {
+  switch (e) {
+  case E::Submit:      return "Submit";
+  case E::Reply:       return "Reply";
+  case E::AudioDone:   return "AudioDone";
+  case E::Silent:      return "Silent";
+  case E::Failed:      return "Failed";
+  case E::HoldElapsed: return "HoldElapsed";
+  case E::Cancel:      return "Cancel";
+  }
+  return "?";
+}
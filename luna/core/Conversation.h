@@ -0,0 +1,59 @@
+// Conversation.h
+
+/*
+  One turn of talking, as a state machine: Idle -> Thinking -> Speaking -> Holding -> Idle
+*/
+#pragma once
+#include <QElapsedTimer>
+#include <QObject>
+#include <QVector>
+
+class QTimer;
+
+class Conversation : public QObject {
+  Q_OBJECT
+public:
+  enum class State { Idle, Thinking, Speaking, Holding };
+  enum class Event {
+    Submit,       // user pressed Enter (also supersedes a reply in progress)
+    Reply,        // text is complete; its audio is queued or about to start
+    AudioDone,    // the reply's last sample played
+    Silent,       // nothing to play after all (no audio, audio error)
+    Failed,       // backend error before the text is complete
+    HoldElapsed,  // the text has been up long enough
+    Cancel,       // user stopped it
+  };
+  Q_ENUM(State)
+  Q_ENUM(Event)
+
+  static constexpr int kDefaultHoldMs = 4000;
+
+  explicit Conversation(QObject* parent=nullptr);
+
+  State state() const { return state_; }
+  // text stays up at least this long after the reply (or an error) arrived
+  void setMinHoldMs(int ms) { holdMs_ = ms; }
+
+  // Looks the event up in the transition table; false (and no signal) if the
+  // current state ignores it. Safe to call from a transitioned() handler:
+  // the event is queued and dispatched once that handler returns.
+  bool post(Event ev);
+
+  static const char* stateName(State s);
+  static const char* eventName(Event e);
+
+signals:
+  // exactly one per accepted event, in order
+  void transitioned(Conversation::State from, Conversation::State to, Conversation::Event ev);
+
+private:
+  State         state_ = State::Idle;
+  int           holdMs_ = kDefaultHoldMs;
+  QTimer*       holdTimer_ = nullptr;
+  QElapsedTimer sinceReply_;          // the hold runs concurrently with speech
+  QVector<Event> queue_;
+  bool          dispatching_ = false;
+
+  static bool next(State from, Event ev, State* to);
+  void enter(State from, Event ev);
+};
@@ -1,16 +1,24 @@
 #include "EmotionSpriteController.h"
 #include "ModeManager.h"
-#include <QFile>
-#include <QJsonDocument>
-#include <QJsonObject>
+#include <QCoreApplication>
+#include <QDir>
 #include <QRandomGenerator>
-#include <QJsonArray>   // ← add this
-#include <QJsonValue>   // ← and this
 #include<QFileInfo>
 
 EmotionSpriteController::EmotionSpriteController(ModeManager* m, QObject* p)
   : QObject(p), modes_(m)
 {
+  // known vocabulary first (same file the LLM prompt is built from), so the
+  // common tokens get stable low ids whatever the mode
+  const QStringList tokenFiles = {
+    QCoreApplication::applicationDirPath() + "/app/emo_tokens.txt",
+    QDir::currentPath() + "/app/emo_tokens.txt" };
+  for (const auto& f : tokenFiles) {
+    if (QFileInfo::exists(f)) { table_.loadTokenFile(f); break; }
+  }
+  smileId_ = table_.intern(QStringLiteral("<E:smile>"));
+  smirkId_ = table_.intern(QStringLiteral("<E:smirk>"));
+
   // keep map in sync with mode changes
   connect(modes_, &ModeManager::modeChanged, this, [this](const QString&){
     reloadForCurrentMode();
@@ -18,80 +26,60 @@ EmotionSpriteController::EmotionSpriteController(ModeManager* m, QObject* p)
   reloadForCurrentMode();
 }
 void EmotionSpriteController::reloadForCurrentMode() {
-  lists_.clear();
+  // parsed once by ModeManager (pack or mode catalog); sum.json is only
+  // re-read when it changes on disk. Basenames are resolved to frame
+  // indices here, once per mode, so applyEmotion never touches strings/disk.
+  const QHash<QString, QStringList>& map = modes_->emotionMap();
   const QString dir = modes_->modeDir();
+  table_.compile(map, [this, &dir](const QString& bn) {
+    const int i = modes_->indexOfBasename(bn);
+    if (i >= 0 || dir.isEmpty()) return i;
+    // listed in sum.json but not in the frame list: one stat, now
+    const QString abs = dir + "/" + bn + ".png";
+    return QFileInfo::exists(abs) ? modes_->appendFrame(abs) : -1;
+  });
 
-  // Prefer sum.json; (optional) fall back to summary/combined if present
-  const QStringList candidates = { "sum.json", "summary.json", "combined.json" };
-  QString jsonPath;
-  for (const auto& name : candidates) {
-    const QString p = dir + "/" + name;
-    if (QFileInfo::exists(p)) { jsonPath = p; break; }
-  }
-  if (jsonPath.isEmpty()) {
-    return;
-  }
-
-  QFile f(jsonPath);
-  if (!f.open(QIODevice::ReadOnly)) return;   // ← add this
-
-  const QJsonDocument doc = QJsonDocument::fromJson(f.readAll());
-
-  const QJsonObject obj = doc.object();
-  for (auto it = obj.begin(); it != obj.end(); ++it) {
-    if (!it.value().isArray()) continue;
-    QStringList v;
-    for (const QJsonValue& e : it.value().toArray())
-      if (e.isString()) v << e.toString();
-    if (!v.isEmpty()) lists_.insert(it.key(), v);
-  }
+  // decode emotion frames ahead of the rest of the mode
+  QStringList wanted;
+  for (auto it = map.cbegin(); it != map.cend(); ++it) wanted << *it;
+  wanted.removeDuplicates();
+  modes_->prefetchBasenames(wanted);
 }
 
-QString EmotionSpriteController::pickOne(const QString& token) const {
-  const auto it = lists_.find(token);
-  if (it == lists_.end() || it->isEmpty()) return {};
-  const int idx = QRandomGenerator::global()->bounded(it->size());
-  return it->at(idx);
+int EmotionSpriteController::pickOne(int id) const {
+  // exact token first, then the first part of a compound token that has frames
+  const QVector<int>* frames = table_.framesOrFallback(id);
+  if (!frames) return -1;
+  return frames->at(QRandomGenerator::global()->bounded(frames->size()));
 }
 
 bool EmotionSpriteController::applyEmotion(const QString& token) {
+  // one hash for a known token; an unseen compound ("<M:x>|<E:y>" that no
+  // sum.json lists) is split and interned once, then falls back by its parts
+  return applyEmotionId(table_.resolve(token.trimmed()));
+}
+
+bool EmotionSpriteController::applyEmotionId(int id) {
   // --- bias to smile with some probability ---
   constexpr int kSmileProbPct = 25;                              // ← 25% chance
-  static const QString kSmile = QStringLiteral("<E:smile>");
-  QString chosen = token.trimmed();
+  int chosen = id;
 
-  if (chosen != kSmile && kSmileProbPct > 0) {
+  if (chosen != smileId_ && kSmileProbPct > 0) {
     // only consider bias if we actually have smile frames in sum.json
-    const bool haveSmile = lists_.contains(kSmile) && !lists_.value(kSmile).isEmpty();
+    const bool haveSmile = !table_.frames(smileId_).isEmpty();
     if (haveSmile && QRandomGenerator::global()->bounded(100) < kSmileProbPct) {
-      chosen = kSmile;
+      chosen = smileId_;
     }
   }
 
-  // --- existing selection logic (unchanged), but use 'chosen' instead of 'token' ---
-  const QString base = pickOne(chosen);
-
-  if (base.isEmpty()) return false;
-
-  // try by basename (indexed frames)
-  if (modes_->setFrameByBasename(base)) {
-    const QString abs = modes_->modeDir() + "/" + base + ".png";
-    return true;
-  }
-
-  // fallback: absolute path
-  const QString abs = modes_->modeDir() + "/" + base + ".png";
-  const bool exists = QFileInfo::exists(abs);
-  if (exists) {
-    const bool ok = modes_->ensureAndSetFramePath(abs);
-    return ok;
-  }
-
-  return false;
+  if (chosen < 0) return false;                                  // unknown token
+  const int frame = pickOne(chosen);
+  if (frame < 0) return false;
+  return modes_->setFrame(frame);
 }
 
 void EmotionSpriteController::maybeSmirk(int probabilityPct) {
   probabilityPct = qBound(0, probabilityPct, 100);
   if (QRandomGenerator::global()->bounded(100) < probabilityPct)
-    applyEmotion(QStringLiteral("<E:smirk>"));
+    applyEmotionId(smirkId_);
 }
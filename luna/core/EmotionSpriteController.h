@@ -2,6 +2,7 @@
 #include <QObject>
 #include <QHash>
 #include <QStringList>
+#include "EmotionTable.h"
 
 class ModeManager;
 
@@ -10,8 +11,10 @@ class EmotionSpriteController : public QObject {
 public:
   explicit EmotionSpriteController(ModeManager* modes, QObject* parent=nullptr);
 
-  void reloadForCurrentMode();           // read <modeDir>/summary.json
+  void reloadForCurrentMode();           // compile the mode's emotion map into frame indices
   bool applyEmotion(const QString& token); // set frame by token
+  bool applyEmotionId(int id);             // same, for an id from emotions()
+  const EmotionTable& emotions() const { return table_; }
   void maybeSmirk(int probabilityPct = 30);
 
 signals:
@@ -20,6 +23,8 @@ signals:
 
 private:
   ModeManager* modes_;
-  QHash<QString, QStringList> lists_;    // "<E:smile>" -> ["lun_s_..."]
-  QString pickOne(const QString& token) const;
+  EmotionTable table_;                   // "<E:smile>" -> id -> frame indices
+  int smileId_ = -1;
+  int smirkId_ = -1;
+  int pickOne(int id) const;             // frame index, -1 if the token has none
 };
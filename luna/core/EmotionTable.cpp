@@ -0,0 +1,121 @@
+/*
+
+EmotionTable
+
+Token strings are hashed once, when the mode's emotion map is compiled;
+applying an emotion from the backend is then one hash lookup for the
+incoming token, an array index and an RNG draw. No path building and no
+disk access on that path.
+
+*/
+
+#include "EmotionTable.h"
+#include <QFile>
+#include <algorithm>
+
+static const QVector<int> kNone;
+
+QString EmotionTable::canonical(const QString& token) {
+  const QString t = token.trimmed();
+  if (!t.contains(QLatin1Char('|'))) return t;
+  QStringList parts;
+  for (const auto& p : t.split(QLatin1Char('|'), Qt::SkipEmptyParts)) {
+    const QString s = p.trimmed();
+    if (!s.isEmpty()) parts << s;
+  }
+  std::sort(parts.begin(), parts.end());
+  parts.removeDuplicates();
+  return parts.join(QLatin1Char('|'));
+}
+
+// "|"-separated parts, trimmed, empties and repeats dropped, order kept
+static QStringList splitParts(const QString& token) {
+  QStringList parts;
+  for (const auto& p : token.split(QLatin1Char('|'), Qt::SkipEmptyParts)) {
+    const QString s = p.trimmed();
+    if (!s.isEmpty() && !parts.contains(s)) parts << s;
+  }
+  return parts;
+}
+
+int EmotionTable::intern(const QString& token) {
+  const QString raw = token.trimmed();
+  if (raw.isEmpty()) return -1;
+  if (const auto it = ids_.constFind(raw); it != ids_.constEnd()) return *it;
+
+  // frames live on the canonical spelling; intern it first so any other
+  // spelling can point at it
+  const QString key = canonical(raw);
+  const int cid = (key == raw) ? -1 : intern(key);
+
+  const int id = names_.size();
+  names_ << raw;
+  canon_ << (cid < 0 ? id : cid);
+  ids_.insert(raw, id);
+  parts_.push_back({});
+  if (raw.contains(QLatin1Char('|'))) {
+    QVector<int> comps;
+    for (const auto& p : splitParts(raw)) comps << intern(p);
+    parts_[id] = comps;
+  }
+  return id;
+}
+
+int EmotionTable::find(const QString& token) const {
+  const int id = ids_.value(token, -1);
+  if (id >= 0 || !token.contains(QLatin1Char('|'))) return id;
+  return ids_.value(canonical(token), -1);
+}
+
+int EmotionTable::resolve(const QString& token) {
+  const int id = ids_.value(token, -1);
+  return id >= 0 ? id : intern(token);
+}
+
+const QVector<int>& EmotionTable::components(int id) const {
+  return (id >= 0 && id < parts_.size()) ? parts_.at(id) : kNone;
+}
+
+void EmotionTable::loadTokenFile(const QString& path) {
+  QFile f(path);
+  if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) return;
+  while (!f.atEnd()) {
+    const QString line = QString::fromUtf8(f.readLine()).trimmed();
+    if (!line.isEmpty()) intern(line);
+  }
+}
+
+void EmotionTable::internKeys(const QHash<QString, QStringList>& map) {
+  for (auto it = map.cbegin(); it != map.cend(); ++it) intern(it.key());
+}
+
+void EmotionTable::compile(const QHash<QString, QStringList>& map,
+                           const std::function<int(const QString&)>& resolve) {
+  internKeys(map);
+  frames_.clear();
+  frames_.resize(names_.size());
+  for (auto it = map.cbegin(); it != map.cend(); ++it) {
+    const int id = canonOf(find(it.key().trimmed()));
+    if (id < 0) continue;
+    QVector<int>& out = frames_[id];
+    for (const auto& bn : it.value()) {
+      const int idx = resolve(bn);
+      if (idx >= 0 && !out.contains(idx)) out << idx;
+    }
+  }
+}
+
+const QVector<int>& EmotionTable::frames(int id) const {
+  id = canonOf(id);                       // ids interned after compile() have no row
+  return (id >= 0 && id < frames_.size()) ? frames_.at(id) : kNone;
+}
+
+const QVector<int>* EmotionTable::framesOrFallback(int id) const {
+  const QVector<int>& exact = frames(id);
+  if (!exact.isEmpty()) return &exact;
+  for (int c : components(id)) {
+    const QVector<int>& f = frames(c);
+    if (!f.isEmpty()) return &f;
+  }
+  return nullptr;
+}
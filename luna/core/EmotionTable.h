@@ -0,0 +1,48 @@
+// EmotionTable.h
+
+/*
+  Emotion tokens interned to small ints + per-mode frame-index vectors per token
+*/
+#pragma once
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+
+class EmotionTable {
+public:
+  // Interns a token ("<E:smile>", "<M:eyes_closed>|<E:serious>"). Compound
+  // tokens share frames through a canonical (sorted parts) form; each other
+  // spelling gets its own id that keeps its parts in the order given, so the
+  // fallback tries the first-named part first.
+  int     intern(const QString& token);
+  int     find(const QString& token) const;        // -1 if never interned
+  // find(), and on a miss intern the token so the split is paid once
+  int     resolve(const QString& token);
+  QString name(int id) const { return names_.value(id); }
+  int     size() const { return names_.size(); }
+  const QVector<int>& components(int id) const;    // empty for simple tokens; spelling order
+
+  void loadTokenFile(const QString& path);         // app/emo_tokens.txt: one token per line
+  void internKeys(const QHash<QString, QStringList>& map);
+
+  // Build the current mode's id -> frame indices table. resolve maps a
+  // basename to a frame index (or -1 to drop it).
+  void compile(const QHash<QString, QStringList>& map,
+               const std::function<int(const QString&)>& resolve);
+  const QVector<int>& frames(int id) const;
+  // frames for id, else for its first component that has any; null if none
+  const QVector<int>* framesOrFallback(int id) const;
+
+  static QString canonical(const QString& token);
+
+private:
+  int canonOf(int id) const { return (id >= 0 && id < canon_.size()) ? canon_.at(id) : -1; }
+
+  QHash<QString, int>   ids_;      // trimmed spelling -> id
+  QStringList           names_;    // spelling by id
+  QVector<int>          canon_;    // id -> id of its canonical spelling (itself if canonical)
+  QVector<QVector<int>> parts_;    // compound -> component ids, in spelling order
+  QVector<QVector<int>> frames_;   // canonical id -> frame indices (current mode)
+};
@@ -0,0 +1,54 @@
+/*
+
+FrameCache
+
+QCache keyed by absolute PNG path; cost of an entry is QImage::sizeInBytes(),
+so maxCost is a byte budget and QCache evicts least-recently-used frames
+once the budget is exceeded.
+
+Frames are stored premultiplied so QPainter can blit them without a
+per-paint format conversion.
+
+*/
+
+#include "FrameCache.h"
+#include <QImageReader>
+
+FrameCache::FrameCache(qint64 budgetBytes) {
+  setBudgetBytes(budgetBytes);
+}
+
+void FrameCache::setBudgetBytes(qint64 bytes) {
+  cache_.setMaxCost(qMax<qint64>(0, bytes));
+}
+
+QImage FrameCache::find(const QString& path) {
+  if (const QImage* img = cache_.object(path)) { ++hits_; return *img; }
+  ++misses_;
+  return QImage();
+}
+
+QImage FrameCache::image(const QString& path) {
+  if (path.isEmpty()) return QImage();
+  if (const QImage* img = cache_.object(path)) { ++hits_; return *img; }
+  ++misses_;
+
+  const QImage img = decode(path);
+  if (!img.isNull()) insert(path, img);
+  return img;   // implicitly shared with the cached copy
+}
+
+void FrameCache::insert(const QString& path, const QImage& img) {
+  if (path.isEmpty() || img.isNull()) return;
+  // QCache takes ownership; an entry larger than the whole budget is dropped
+  cache_.insert(path, new QImage(img), qMax<qsizetype>(1, img.sizeInBytes()));
+}
+
+QImage FrameCache::decode(const QString& path) {
+  QImageReader reader(path);
+  QImage img = reader.read();
+  if (img.isNull()) return img;
+  if (img.format() != QImage::Format_ARGB32_Premultiplied)
+    img.convertTo(QImage::Format_ARGB32_Premultiplied);
+  return img;
+}
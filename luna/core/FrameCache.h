@@ -0,0 +1,41 @@
+// FrameCache.h
+
+/*
+  Decoded-frame LRU (path -> QImage) with a byte budget + hit/miss counters
+*/
+#pragma once
+#include <QCache>
+#include <QImage>
+#include <QString>
+
+class FrameCache {
+public:
+  static constexpr qint64 kDefaultBudgetBytes = 192ll * 1024 * 1024;  // ~50 full 1280x720 frames
+
+  explicit FrameCache(qint64 budgetBytes = kDefaultBudgetBytes);
+
+  // Decoded image for a PNG path; decodes + inserts on miss.
+  QImage image(const QString& path);
+  // Lookup only (no decode). Null image on miss.
+  QImage find(const QString& path);
+  bool   contains(const QString& path) const { return cache_.contains(path); }
+  void   insert(const QString& path, const QImage& img);
+  void   remove(const QString& path) { cache_.remove(path); }
+  void   clear() { cache_.clear(); }
+
+  void   setBudgetBytes(qint64 bytes);
+  qint64 budgetBytes() const { return cache_.maxCost(); }
+  qint64 usedBytes()   const { return cache_.totalCost(); }
+
+  quint64 hits()   const { return hits_; }
+  quint64 misses() const { return misses_; }
+  void    resetStats() { hits_ = misses_ = 0; }
+
+  // Decode a PNG into the format we paint with (premultiplied ARGB32).
+  static QImage decode(const QString& path);
+
+private:
+  QCache<QString, QImage> cache_;   // cost = bytes
+  quint64 hits_   = 0;
+  quint64 misses_ = 0;
+};
@@ -0,0 +1,135 @@
+/*
+
+FrameIndex
+
+Built once per mode from PNG headers so layout (sizeHint, imageRect,
+window resize, IO overlay placement) can answer in O(1) without touching
+pixels. The opaque box needs alpha, so it starts as the full canvas and
+is tightened the first time the frame is decoded (the background prefetch
+decodes the whole mode right after it loads). The hit mask is a banded
+QRegion of kHitCell squares holding every pixel with alpha > 0, used as the
+pet window's mask. That mask is the window shape on xcb and Windows, not
+just an input region, so anything left out would not be drawn either:
+clicks go through only where the sprite is fully transparent.
+
+*/
+
+#include "FrameIndex.h"
+#include <QImage>
+#include <QImageReader>
+#include <algorithm>
+
+void FrameIndex::build(const QStringList& paths) {
+  infos_.clear();
+  infos_.reserve(paths.size());
+  for (const auto& p : paths) infos_.push_back(readHeader(p));
+  unionDirty_ = true;
+}
+
+void FrameIndex::append(const QString& path) {
+  infos_.push_back(readHeader(path));
+  unionDirty_ = true;
+}
+
+void FrameIndex::setOpaqueRect(int i, const QRect& r) {
+  if (i < 0 || i >= infos_.size()) return;
+  infos_[i].opaqueRect  = r;
+  infos_[i].opaqueKnown = true;
+  unionDirty_ = true;
+}
+
+void FrameIndex::setHitMask(int i, const QRegion& mask) {
+  if (i < 0 || i >= infos_.size()) return;
+  infos_[i].hitMask   = mask;
+  infos_[i].maskKnown = true;
+}
+
+QRect FrameIndex::unionOpaqueRect() const {
+  if (!unionDirty_) return union_;
+  unionDirty_ = false;
+
+  QRect canvas, opaque;
+  bool allKnown = true;
+  for (const auto& fi : infos_) {
+    canvas = canvas.united(QRect(QPoint(0, 0), fi.size));
+    if (fi.opaqueKnown) opaque = opaque.united(fi.opaqueRect);
+    else                allKnown = false;
+  }
+  union_ = (allKnown && !opaque.isEmpty()) ? opaque : canvas;
+  return union_;
+}
+
+FrameInfo FrameIndex::readHeader(const QString& path) {
+  FrameInfo fi;
+  QImageReader reader(path);
+  fi.size = reader.size();                       // IHDR only
+  if (fi.size.isValid()) fi.opaqueRect = QRect(QPoint(0, 0), fi.size);
+  return fi;
+}
+
+QRect FrameIndex::opaqueBounds(const QImage& src) {
+  if (src.isNull()) return QRect();
+  if (!src.hasAlphaChannel()) return src.rect();
+
+  const QImage img = (src.format() == QImage::Format_ARGB32_Premultiplied ||
+                      src.format() == QImage::Format_ARGB32)
+                   ? src : src.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+  const int w = img.width(), h = img.height();
+
+  auto rowHasAlpha = [&](int y) {
+    const QRgb* line = reinterpret_cast<const QRgb*>(img.constScanLine(y));
+    for (int x = 0; x < w; ++x) if (qAlpha(line[x])) return true;
+    return false;
+  };
+
+  int top = 0;
+  while (top < h && !rowHasAlpha(top)) ++top;
+  if (top == h) return QRect();                  // fully transparent
+  int bottom = h - 1;
+  while (bottom > top && !rowHasAlpha(bottom)) --bottom;
+
+  int left = w, right = -1;
+  for (int y = top; y <= bottom; ++y) {
+    const QRgb* line = reinterpret_cast<const QRgb*>(img.constScanLine(y));
+    for (int x = 0; x < left; ++x)      if (qAlpha(line[x])) { left = x; break; }
+    for (int x = w - 1; x > right; --x) if (qAlpha(line[x])) { right = x; break; }
+  }
+  return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+QRegion FrameIndex::hitMask(const QImage& src) {
+  if (src.isNull()) return QRegion();
+  if (!src.hasAlphaChannel()) return QRegion(src.rect());
+
+  const QImage img = (src.format() == QImage::Format_ARGB32_Premultiplied ||
+                      src.format() == QImage::Format_ARGB32)
+                   ? src : src.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+  const int w = img.width(), h = img.height();
+  const int cols = (w + kHitCell - 1) / kHitCell;
+
+  // one band per cell row; runs of hit cells become rects, already in the
+  // y-then-x banded order QRegion::setRects expects
+  QVector<QRect> rects;
+  QVector<char>  hit(cols);
+  for (int y0 = 0; y0 < h; y0 += kHitCell) {
+    const int y1 = qMin(h, y0 + kHitCell);
+    std::fill(hit.begin(), hit.end(), 0);
+    for (int y = y0; y < y1; ++y) {
+      const QRgb* line = reinterpret_cast<const QRgb*>(img.constScanLine(y));
+      for (int x = 0; x < w; ++x)
+        if (qAlpha(line[x]) >= kHitAlpha) hit[x / kHitCell] = 1;
+    }
+    for (int c = 0; c < cols; ) {
+      if (!hit[c]) { ++c; continue; }
+      const int start = c;
+      while (c < cols && hit[c]) ++c;
+      const int x0 = start * kHitCell;
+      const int x1 = qMin(w, c * kHitCell);
+      rects.push_back(QRect(x0, y0, x1 - x0, y1 - y0));
+    }
+  }
+
+  QRegion r;
+  if (!rects.isEmpty()) r.setRects(rects.constData(), int(rects.size()));
+  return r;
+}
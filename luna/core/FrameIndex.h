@@ -0,0 +1,58 @@
+// FrameIndex.h
+
+/*
+  Per-mode frame metadata (dimensions, opaque bounding box, alpha hit mask); no pixels
+*/
+#pragma once
+#include <QRect>
+#include <QRegion>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QImage;
+
+struct FrameInfo {
+  QSize size;                 // full canvas size, from the PNG header
+  QRect opaqueRect;           // tight box around alpha > 0 (canvas coords)
+  bool  opaqueKnown = false;  // false until the frame has been decoded once
+  QRegion hitMask;            // visible/clickable area (alpha >= kHitAlpha), kHitCell granularity
+  bool  maskKnown = false;
+};
+
+class FrameIndex {
+public:
+  static constexpr int kHitCell  = 8;    // px; coarse enough to keep the region small
+  // The mask ends up as the window shape, which clips painting too (xcb,
+  // Windows): every visible pixel has to be inside, faint edges included
+  static constexpr int kHitAlpha = 1;
+
+  // Reads only PNG headers (QImageReader::size), never decodes pixels.
+  void build(const QStringList& paths);
+  void append(const QString& path);
+  void append(const FrameInfo& fi) { infos_.push_back(fi); unionDirty_ = true; }
+  void assign(const QVector<FrameInfo>& infos) { infos_ = infos; unionDirty_ = true; }
+  void clear() { infos_.clear(); unionDirty_ = true; }
+
+  int  size() const { return infos_.size(); }
+  const FrameInfo& at(int i) const { return infos_.at(i); }
+  FrameInfo value(int i) const { return (i >= 0 && i < infos_.size()) ? infos_.at(i) : FrameInfo{}; }
+
+  // fill in the alpha data the first time the frame's pixels are available
+  void setOpaqueRect(int i, const QRect& r);
+  void setHitMask(int i, const QRegion& mask);
+
+  // Union of every frame's opaque box: the crop used for the whole mode.
+  // Falls back to the full canvas until every frame's box is known.
+  QRect unionOpaqueRect() const;
+
+  static FrameInfo readHeader(const QString& path);
+  static QRect     opaqueBounds(const QImage& img);
+  static QRegion   hitMask(const QImage& img);
+
+private:
+  QVector<FrameInfo> infos_;
+  mutable QRect      union_;
+  mutable bool       unionDirty_ = true;
+};
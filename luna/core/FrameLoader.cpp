@@ -0,0 +1,73 @@
+/*
+
+FrameLoader
+
+Decodes PNGs (and computes their opaque box + hit mask) on worker threads so the GUI
+thread never waits on zlib inflate. Jobs are prioritised through
+QThreadPool: the frame on screen first, frames referenced by the mode's
+sum.json next, the rest of the mode last. setMode() queues the whole mode at
+Background before anything asks for a frame, so a later, more urgent request
+for the same path queues a second runnable at the higher priority; whichever
+copy starts first claims the Job and the stale one returns without decoding.
+
+Results are marshalled back with a queued invokeMethod, so FrameCache and
+FrameIndex are only ever touched from the GUI thread.
+
+*/
+
+#include "FrameLoader.h"
+#include "FrameCache.h"
+#include "FrameIndex.h"
+#include <QThread>
+#include <QThreadPool>
+
+FrameLoader::FrameLoader(QObject* parent)
+  : QObject(parent), pool_(new QThreadPool(this))
+{
+  // leave headroom for the GUI thread and the audio/network stack
+  pool_->setMaxThreadCount(qBound(1, QThread::idealThreadCount() - 1, 4));
+  pool_->setObjectName(QStringLiteral("FrameLoader"));
+}
+
+FrameLoader::~FrameLoader() {
+  pool_->clear();
+  pool_->waitForDone();
+}
+
+void FrameLoader::request(const QString& path, int priority) {
+  if (path.isEmpty()) return;
+  if (const JobPtr job = pending_.value(path)) {
+    if (priority <= job->priority || job->state.loadAcquire() != Queued) return;
+    job->priority = priority;                     // bump: the old copy becomes a no-op
+    submit(path, job);
+    return;
+  }
+  JobPtr job(new Job);
+  job->priority = priority;
+  pending_.insert(path, job);
+  submit(path, job);
+}
+
+void FrameLoader::submit(const QString& path, const JobPtr& job) {
+  pool_->start([this, path, job]{
+    if (!job->state.testAndSetOrdered(Queued, Running)) return;   // stale copy or cancelled
+    const QImage img = FrameCache::decode(path);
+    const QRect   box  = FrameIndex::opaqueBounds(img);
+    const QRegion mask = FrameIndex::hitMask(img);
+    QMetaObject::invokeMethod(this, [this, path, job, img, box, mask]{
+      if (pending_.value(path) == job) pending_.remove(path);
+      if (img.isNull()) emit failed(path);
+      else              emit decoded(path, img, box, mask);
+    }, Qt::QueuedConnection);
+  }, job->priority);
+}
+
+void FrameLoader::cancelPending() {
+  // only forget paths whose job never started: a running decode still
+  // reports back, and re-requesting it meanwhile would decode it twice
+  for (auto it = pending_.begin(); it != pending_.end(); ) {
+    if (it.value()->state.testAndSetOrdered(Queued, Cancelled)) it = pending_.erase(it);
+    else ++it;
+  }
+  pool_->clear();       // queued runnables; the cancelled ones would bail anyway
+}
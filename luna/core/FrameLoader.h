@@ -0,0 +1,55 @@
+// FrameLoader.h
+
+/*
+  Background PNG decoding on a dedicated thread pool; results come back on the GUI thread
+*/
+#pragma once
+#include <QObject>
+#include <QAtomicInt>
+#include <QHash>
+#include <QImage>
+#include <QRect>
+#include <QRegion>
+#include <QSharedPointer>
+#include <QString>
+
+class QThreadPool;
+
+class FrameLoader : public QObject {
+  Q_OBJECT
+public:
+  // QThreadPool priorities (higher runs first)
+  enum Priority { Background = 0, Emotion = 50, Current = 100 };
+
+  explicit FrameLoader(QObject* parent=nullptr);
+  ~FrameLoader() override;
+
+  // queue a decode; a path already queued at a lower priority is bumped,
+  // one already queued higher (or running) is left alone
+  void request(const QString& path, int priority = Background);
+  bool isPending(const QString& path) const { return pending_.contains(path); }
+  // drop everything that has not started yet (e.g. on mode switch); jobs
+  // already decoding still report back and stay pending until they do
+  void cancelPending();
+
+signals:
+  // emitted on the loader's (GUI) thread; img is premultiplied ARGB32
+  void decoded(const QString& path, const QImage& img,
+               const QRect& opaqueRect, const QRegion& hitMask);
+  void failed(const QString& path);
+
+private:
+  // shared by every runnable queued for one path: the first to flip it
+  // Queued -> Running decodes, the others (stale lower-priority copies) bail
+  enum JobState { Queued = 0, Running = 1, Cancelled = 2 };
+  struct Job {
+    QAtomicInt state { Queued };
+    int        priority = Background;
+  };
+  using JobPtr = QSharedPointer<Job>;
+
+  QThreadPool*           pool_ = nullptr;
+  QHash<QString, JobPtr> pending_;   // GUI thread only
+
+  void submit(const QString& path, const JobPtr& job);
+};
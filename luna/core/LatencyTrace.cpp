@@ -0,0 +1,174 @@
+/*
+
+LatencyTrace
+
+Where does the time go between Enter and Luna's voice? Each stage stamps
+itself once per turn (QElapsedTimer, monotonic), relative to Submit. When
+the turn ends the record goes into a fixed ring that the stats panel and
+the export copy from. mark() itself never allocates; the optional CSV log
+line is written when a turn ends.
+
+A record stays open per request id until that turn's Finished. With a
+message typed ahead, the turn that is still speaking keeps its record (and
+the player's stages) while the next one's LLM/TTS stages fill another; if
+one global turn were closed on every submit, back-to-back turns would
+silently drop out of the audio-stage percentiles.
+
+Everything here runs on the GUI thread (the player, the sink and
+BackendClient all live there), so there is no locking.
+
+*/
+
+#include "LatencyTrace.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStringList>
+#include <QTextStream>
+#include <algorithm>
+
+LatencyTrace& LatencyTrace::instance() {
+  static LatencyTrace t;
+  return t;
+}
+
+LatencyTrace::LatencyTrace() {
+  clock_.start();
+}
+
+const char* LatencyTrace::stageName(Stage s) {
+  static const char* kNames[StageCount] = {
+    "submit", "llm_ttfb", "llm_done", "emotion", "tts_req",
+    "tts_resp", "audio_set", "first_sample", "finished" };
+  return (s >= 0 && s < StageCount) ? kNames[s] : "?";
+}
+
+void LatencyTrace::begin(int requestId) {
+  // superseded turns: keep what they reached; the one still speaking stays
+  for (Open& o : open_)
+    if (o.used && (audioTurn_ == 0 || o.rec.requestId != audioTurn_)) close(o);
+
+  Open* slot = nullptr;
+  for (Open& o : open_) if (!o.used) { slot = &o; break; }
+  if (!slot) {                                     // can't happen with one turn ahead; be safe
+    slot = &open_[0];
+    for (Open& o : open_) if (o.t0Ns < slot->t0Ns) slot = &o;
+    close(*slot);
+  }
+  slot->used          = true;
+  slot->t0Ns          = clock_.nsecsElapsed();
+  slot->rec.requestId = requestId;
+  slot->rec.wallMs    = QDateTime::currentMSecsSinceEpoch();
+  slot->rec.us.fill(-1);
+  slot->rec.us[Submit] = 0;
+  current_ = requestId;
+}
+
+void LatencyTrace::markStage(Stage s) {
+  markStage(s, (s >= AudioSourceSet && audioTurn_ != 0) ? audioTurn_ : current_);
+}
+
+void LatencyTrace::markStage(Stage s, int requestId) {
+  if (s < 0 || s >= StageCount) return;
+  Open* o = find(requestId);
+  if (!o || o->rec.us[s] >= 0) return;
+  o->rec.us[s] = (clock_.nsecsElapsed() - o->t0Ns) / 1000;
+  if (s == Finished) close(*o);
+}
+
+void LatencyTrace::end(int requestId) {
+  if (Open* o = find(requestId)) close(*o);
+}
+
+LatencyTrace::Open* LatencyTrace::find(int requestId) {
+  for (Open& o : open_) if (o.used && o.rec.requestId == requestId) return &o;
+  return nullptr;
+}
+
+void LatencyTrace::close(Open& o) {
+  if (!o.used) return;
+  o.used = false;
+  push(o.rec);
+  if (!logFile_.isEmpty()) appendLog(o.rec);
+}
+
+void LatencyTrace::push(const Record& r) {
+  ring_[head_ % kRing] = r;
+  ++head_;
+}
+
+QVector<LatencyTrace::Record> LatencyTrace::snapshot() const {
+  const quint32 h = head_;
+  const quint32 n = qMin<quint32>(h, kRing);
+  QVector<Record> out;
+  out.reserve(int(n));
+  for (quint32 i = h - n; i != h; ++i) out.push_back(ring_[i % kRing]);
+  return out;
+}
+
+qint64 LatencyTrace::percentileUs(const QVector<Record>& recs, Stage s, double p) {
+  QVector<qint64> v;
+  v.reserve(recs.size());
+  for (const auto& r : recs) if (r.us[s] >= 0) v.push_back(r.us[s]);
+  if (v.isEmpty()) return -1;
+  std::sort(v.begin(), v.end());
+  const int idx = qBound(0, int(p / 100.0 * (v.size() - 1) + 0.5), int(v.size()) - 1);
+  return v.at(idx);
+}
+
+QString LatencyTrace::summary() const {
+  const QVector<Record> recs = snapshot();
+  QString out;
+  QTextStream ts(&out);
+  ts << QStringLiteral("%1 %2 %3 %4 %5\n").arg("stage", -13).arg("n", 4)
+                                          .arg("p50", 8).arg("p95", 8).arg("max", 8);
+  auto ms = [](qint64 us) {
+    return us < 0 ? QStringLiteral("-") : QString::number(us / 1000.0, 'f', 1);
+  };
+  for (int s = LlmFirstByte; s < StageCount; ++s) {
+    const auto st = Stage(s);
+    int n = 0;
+    for (const auto& r : recs) if (r.us[st] >= 0) ++n;
+    ts << QStringLiteral("%1 %2 %3 %4 %5\n").arg(stageName(st), -13).arg(n, 4)
+            .arg(ms(percentileUs(recs, st, 50)), 8)
+            .arg(ms(percentileUs(recs, st, 95)), 8)
+            .arg(ms(percentileUs(recs, st, 100)), 8);
+  }
+  ts << QStringLiteral("(ms since Enter, last %1 turns)").arg(recs.size());
+  return out;
+}
+
+static QString csvHeader() {
+  QStringList cols{ "request_id", "wall_ms" };
+  for (int s = 0; s < LatencyTrace::StageCount; ++s)
+    cols << QString::fromLatin1(LatencyTrace::stageName(LatencyTrace::Stage(s))) + "_us";
+  return cols.join(',');
+}
+
+static QString csvRow(const LatencyTrace::Record& r) {
+  QStringList cols{ QString::number(r.requestId), QString::number(r.wallMs) };
+  for (qint64 us : r.us) cols << (us < 0 ? QString() : QString::number(us));
+  return cols.join(',');
+}
+
+bool LatencyTrace::exportCsv(const QString& path) const {
+  QDir().mkpath(QFileInfo(path).absolutePath());
+  QSaveFile f(path);
+  if (!f.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+  QTextStream ts(&f);
+  ts << csvHeader() << '\n';
+  for (const auto& r : snapshot()) ts << csvRow(r) << '\n';
+  ts.flush();
+  return f.commit();
+}
+
+void LatencyTrace::appendLog(const Record& r) const {
+  QFile f(logFile_);
+  const bool fresh = !f.exists() || f.size() == 0;
+  if (!f.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) return;
+  QTextStream ts(&f);
+  if (fresh) ts << csvHeader() << '\n';
+  ts << csvRow(r) << '\n';
+}
@@ -0,0 +1,88 @@
+// LatencyTrace.h
+
+/*
+  Monotonic per-stage timestamps for Enter -> speech; ring of recent turns, p50/p95, CSV export
+*/
+#pragma once
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+#include <array>
+
+class LatencyTrace {
+public:
+  enum Stage {
+    Submit,           // Enter in IOOverlay -> BackendClient::submit
+    LlmFirstByte,     // first bytes of the LLM reply
+    LlmDone,          // whole sentence known
+    EmotionApplied,   // face switched to the reply's emotion
+    TtsRequest,       // first clause sent to TTS (or served from the cache)
+    TtsResponse,      // first clause's audio available
+    AudioSourceSet,   // first clip handed to the player / sink
+    FirstSample,      // player/sink actually started
+    Finished,         // last clip ended
+    StageCount
+  };
+  static constexpr int kRing = 256;       // turns kept for the stats
+
+  // one completed turn: µs since Submit per stage, -1 = never reached
+  struct Record {
+    int    requestId = 0;
+    qint64 wallMs    = 0;                 // when it started (for the log)
+    std::array<qint64, StageCount> us;
+  };
+
+  static LatencyTrace& instance();
+  // first one per turn wins. Without an id: pipeline stages go to the newest
+  // turn, player stages (AudioSourceSet on) to the turn whose audio is playing
+  static void mark(Stage s)                { instance().markStage(s); }
+  static void mark(Stage s, int requestId) { instance().markStage(s, requestId); }
+
+  // starts a turn; open turns are closed (keeping what they reached) except
+  // one whose audio is still playing under setAudioHeld
+  void begin(int requestId);
+  void end(int requestId);                // turn complete without Finished (no audio)
+  void markStage(Stage s);
+  void markStage(Stage s, int requestId);
+  // typed ahead: the audio playing belongs to the turn that is current now,
+  // which stays open (and gets the player's stages) until its Finished; the
+  // next turn's own player stages count from when its output is released
+  void setAudioHeld(bool held) { audioTurn_ = held ? current_ : 0; }
+
+  // recent turns, oldest first (a copy; GUI thread, like the marks)
+  QVector<Record> snapshot() const;
+  // p in [0,100] over turns that reached the stage; -1 if none
+  static qint64 percentileUs(const QVector<Record>& recs, Stage s, double p);
+
+  QString summary() const;                // text table: stage, n, p50, p95, max (ms)
+  bool    exportCsv(const QString& path) const;
+  void    setLogFile(const QString& path) { logFile_ = path; }   // append a CSV row per turn
+
+  static const char* stageName(Stage s);
+
+private:
+  LatencyTrace();
+
+  // the playing turn + one typed ahead, with slack for superseded ones
+  static constexpr int kMaxOpen = 4;
+  struct Open {
+    Record rec{};
+    qint64 t0Ns = 0;                      // its Submit
+    bool   used = false;
+  };
+
+  QElapsedTimer clock_;                   // monotonic
+  std::array<Open, kMaxOpen> open_{};
+  int           current_   = 0;           // newest begin()
+  int           audioTurn_ = 0;           // held: its audio is playing; 0 = current_
+  QString       logFile_;
+
+  // GUI thread only, like every mark(): no locking, snapshot() copies
+  std::array<Record, kRing> ring_{};
+  quint32                   head_ = 0;    // total turns ever pushed
+
+  Open* find(int requestId);
+  void  close(Open& o);
+  void  push(const Record& r);
+  void  appendLog(const Record& r) const;
+};
@@ -0,0 +1,221 @@
+/*
+
+ModeCatalog
+
+Remembers what refreshModes()/loadFramesForMode() and the emotion JSON
+parse produced last time, so startup costs a handful of stat() calls
+instead of listing every folder and reading every PNG header.
+
+Validation is per folder: a folder's mtime changes when PNGs are added,
+removed or renamed, and the emotion JSON is checked by mtime + size.
+Only folders that fail the check are re-scanned. (Overwriting a PNG in
+place with one of a different size is not detected; run luna_pack or
+touch the folder after doing that.)
+
+Stored with QDataStream under QStandardPaths::CacheLocation. Writes learnt
+while frames decode go through saveInBackground(): the hashes are implicitly
+shared, so the snapshot is two refcount bumps and the file I/O runs on the
+global pool. A generation counter keeps a slow older write from landing last.
+
+*/
+
+#include "ModeCatalog.h"
+#include <QAtomicInteger>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+
+static constexpr quint32 kCatalogMagic   = 0x4C434154;   // "LCAT"
+static constexpr quint32 kCatalogVersion = 1;
+
+static QMutex               gWriteMutex;
+static QAtomicInteger<quint64> gSaveGen { 0 };
+static quint64              gWrittenGen = 0;     // guarded by gWriteMutex
+
+static qint64 mtimeOf(const QFileInfo& fi) {
+  return fi.exists() ? fi.lastModified().toMSecsSinceEpoch() : -1;
+}
+
+// ---- serialization ----
+static QDataStream& operator<<(QDataStream& s, const FrameInfo& fi) {
+  return s << fi.size << fi.opaqueRect << fi.opaqueKnown;
+}
+static QDataStream& operator>>(QDataStream& s, FrameInfo& fi) {
+  return s >> fi.size >> fi.opaqueRect >> fi.opaqueKnown;
+}
+static QDataStream& operator<<(QDataStream& s, const ModeCatalog::ModeRecord& r) {
+  return s << r.dirMTime << r.jsonName << r.jsonMTime << r.jsonSize
+           << r.frames << r.infos << r.emotions;
+}
+static QDataStream& operator>>(QDataStream& s, ModeCatalog::ModeRecord& r) {
+  return s >> r.dirMTime >> r.jsonName >> r.jsonMTime >> r.jsonSize
+           >> r.frames >> r.infos >> r.emotions;
+}
+QDataStream& operator<<(QDataStream& s, const ModeCatalog::RootRecord& r) {
+  return s << r.mtime << r.modes;
+}
+QDataStream& operator>>(QDataStream& s, ModeCatalog::RootRecord& r) {
+  return s >> r.mtime >> r.modes;
+}
+
+ModeCatalog::ModeCatalog(const QString& file) : file_(file) {}
+
+QString ModeCatalog::defaultPath() {
+  return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/modes.catalog";
+}
+
+bool ModeCatalog::load() {
+  QFile f(file_);
+  if (!f.open(QIODevice::ReadOnly)) return false;
+  QDataStream in(&f);
+  in.setVersion(QDataStream::Qt_6_0);
+
+  quint32 magic = 0, version = 0;
+  in >> magic >> version;
+  if (magic != kCatalogMagic || version != kCatalogVersion) return false;
+
+  QHash<QString, RootRecord> roots;
+  QHash<QString, ModeRecord> modes;
+  in >> roots >> modes;
+  if (in.status() != QDataStream::Ok) return false;   // corrupt: start over
+
+  roots_ = std::move(roots);
+  modes_ = std::move(modes);
+  dirty_ = false;
+  return true;
+}
+
+bool ModeCatalog::save() {
+  if (!dirty_) return true;
+  if (!write(file_, ++gSaveGen, roots_, modes_)) return false;
+  dirty_ = false;
+  return true;
+}
+
+void ModeCatalog::saveInBackground() {
+  if (!dirty_) return;
+  dirty_ = false;                                 // a failed write only costs a re-scan next start
+  QThreadPool::globalInstance()->start(
+      [file = file_, gen = quint64(++gSaveGen), roots = roots_, modes = modes_]{
+        write(file, gen, roots, modes);
+      });
+}
+
+bool ModeCatalog::write(const QString& file, quint64 gen,
+                        const QHash<QString, RootRecord>& roots,
+                        const QHash<QString, ModeRecord>& modes) {
+  QMutexLocker lock(&gWriteMutex);
+  if (gen <= gWrittenGen) return true;            // a newer snapshot is already on disk
+  QDir().mkpath(QFileInfo(file).absolutePath());
+  QSaveFile f(file);
+  if (!f.open(QIODevice::WriteOnly)) return false;
+  QDataStream out(&f);
+  out.setVersion(QDataStream::Qt_6_0);
+  out << kCatalogMagic << kCatalogVersion << roots << modes;
+  if (!f.commit()) return false;
+  gWrittenGen = gen;
+  return true;
+}
+
+QStringList ModeCatalog::modesUnder(const QString& root) {
+  const qint64 mtime = mtimeOf(QFileInfo(root));
+  auto it = roots_.find(root);
+  if (it != roots_.end() && it->mtime == mtime) return it->modes;
+
+  RootRecord rec;
+  rec.mtime = mtime;
+  rec.modes = QDir(root).entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+  roots_.insert(root, rec);
+  dirty_ = true;
+  return rec.modes;
+}
+
+const ModeCatalog::ModeRecord* ModeCatalog::mode(const QString& dir) {
+  const qint64 mtime = mtimeOf(QFileInfo(dir));
+  if (mtime < 0) return nullptr;
+
+  auto it = modes_.find(dir);
+  if (it == modes_.end() || it->dirMTime != mtime) {
+    it = modes_.insert(dir, scanMode(dir, mtime));    // folder changed: full re-scan
+    dirty_ = true;
+    return &*it;
+  }
+
+  // same files; only the emotion JSON may have been edited
+  if (!it->jsonName.isEmpty()) {
+    const QFileInfo jf(dir + "/" + it->jsonName);
+    if (mtimeOf(jf) != it->jsonMTime || jf.size() != it->jsonSize) {
+      readEmotions(dir, *it);
+      dirty_ = true;
+    }
+  }
+  return &*it;
+}
+
+void ModeCatalog::updateInfos(const QString& dir, const FrameIndex& index, int count) {
+  auto it = modes_.find(dir);
+  if (it == modes_.end()) return;
+  count = qMin(count, qMin(index.size(), int(it->infos.size())));
+  for (int i = 0; i < count; ++i) {
+    const FrameInfo& src = index.at(i);
+    FrameInfo& dst = it->infos[i];
+    if (!src.opaqueKnown || (dst.opaqueKnown && dst.opaqueRect == src.opaqueRect)) continue;
+    dst.size        = src.size;
+    dst.opaqueRect  = src.opaqueRect;
+    dst.opaqueKnown = true;
+    dirty_ = true;
+  }
+}
+
+ModeCatalog::ModeRecord ModeCatalog::scanMode(const QString& dir, qint64 mtime) {
+  ModeRecord rec;
+  rec.dirMTime = mtime;
+  const QDir d(dir);
+  rec.frames = d.entryList({ "*.png", "*.PNG" }, QDir::Files, QDir::Name);
+  rec.infos.reserve(rec.frames.size());
+  for (const auto& f : rec.frames) rec.infos.push_back(FrameIndex::readHeader(d.absoluteFilePath(f)));
+  readEmotions(dir, rec);
+  return rec;
+}
+
+void ModeCatalog::readEmotions(const QString& dir, ModeRecord& rec) {
+  rec.jsonName.clear();
+  rec.jsonMTime = rec.jsonSize = -1;
+  rec.emotions.clear();
+
+  // Prefer sum.json; (optional) fall back to summary/combined if present
+  const QStringList candidates = { "sum.json", "summary.json", "combined.json" };
+  for (const auto& name : candidates) {
+    const QFileInfo fi(dir + "/" + name);
+    if (!fi.exists()) continue;
+    QFile f(fi.absoluteFilePath());
+    if (!f.open(QIODevice::ReadOnly)) return;
+    rec.jsonName  = name;
+    rec.jsonMTime = mtimeOf(fi);
+    rec.jsonSize  = fi.size();
+    rec.emotions  = parseEmotionJson(f.readAll());
+    return;
+  }
+}
+
+QHash<QString, QStringList> ModeCatalog::parseEmotionJson(const QByteArray& json) {
+  QHash<QString, QStringList> out;
+  const QJsonObject obj = QJsonDocument::fromJson(json).object();
+  for (auto it = obj.begin(); it != obj.end(); ++it) {
+    if (!it.value().isArray()) continue;
+    QStringList v;
+    for (const QJsonValue& e : it.value().toArray())
+      if (e.isString()) v << e.toString();
+    if (!v.isEmpty()) out.insert(it.key(), v);
+  }
+  return out;
+}
@@ -0,0 +1,68 @@
+// ModeCatalog.h
+
+/*
+  On-disk cache of mode folders: mode list, frame list + geometry, parsed emotion map
+*/
+#pragma once
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "FrameIndex.h"
+
+class QDataStream;
+
+class ModeCatalog {
+public:
+  struct ModeRecord {
+    qint64             dirMTime  = -1;   // folder mtime: changes when files are added/removed
+    QString            jsonName;         // sum.json / summary.json / combined.json
+    qint64             jsonMTime = -1;
+    qint64             jsonSize  = -1;
+    QStringList        frames;           // PNG file names, sorted
+    QVector<FrameInfo> infos;            // size + opaque box (hit masks are not persisted)
+    QHash<QString, QStringList> emotions;  // "<E:smile>" -> ["lun_s_..."]
+  };
+
+  explicit ModeCatalog(const QString& file = defaultPath());
+
+  bool load();
+  bool save();          // no-op unless something changed
+  // same, but the write happens on a pool thread (snapshot taken now); for
+  // callers on the GUI thread's decode/paint path
+  void saveInBackground();
+  bool isDirty() const { return dirty_; }
+
+  // sub-folders of a search root; re-listed only when the root's mtime changes
+  QStringList modesUnder(const QString& root);
+  // record for a mode folder; the folder is re-scanned only if its mtime
+  // changed, and the emotion JSON re-parsed only if its mtime/size changed
+  const ModeRecord* mode(const QString& dir);
+  // remember opaque boxes learnt from decoding (first `count` frames)
+  void updateInfos(const QString& dir, const FrameIndex& index, int count);
+
+  static QString defaultPath();
+  static QHash<QString, QStringList> parseEmotionJson(const QByteArray& json);
+
+private:
+  struct RootRecord {
+    qint64      mtime = -1;
+    QStringList modes;
+  };
+
+  QString                    file_;
+  QHash<QString, RootRecord> roots_;
+  QHash<QString, ModeRecord> modes_;
+  bool                       dirty_ = false;
+
+  // serialized across threads; a snapshot older than the last one written is dropped
+  static bool write(const QString& file, quint64 gen,
+                    const QHash<QString, RootRecord>& roots,
+                    const QHash<QString, ModeRecord>& modes);
+
+  static ModeRecord scanMode(const QString& dir, qint64 mtime);
+  static void       readEmotions(const QString& dir, ModeRecord& rec);
+
+  friend QDataStream& operator<<(QDataStream&, const RootRecord&);
+  friend QDataStream& operator>>(QDataStream&, RootRecord&);
+};
@@ -19,17 +19,41 @@ Right-click menu uses ModeManager::listModes() to populate submenu; selecting on
 */
 
 #include "ModeManager.h"
+#include "FrameLoader.h"
 #include <QCoreApplication>
 #include <QDir>
 #include <QFileInfo>
 #include <QFileInfoList>
+#include <QSettings>
+
+// ~4 full 1280x720 frames: current face, previous face, and a little slack
+static constexpr qint64 kComposeBudgetBytes = 16ll * 1024 * 1024;
 
 ModeManager::ModeManager(QObject* parent) : QObject(parent) {
+  // decoded-frame budget (MB); default holds a couple of full modes
+  const qint64 mb = QSettings().value("frameCacheMB",
+                                      FrameCache::kDefaultBudgetBytes / (1024 * 1024)).toLongLong();
+  cache_.setBudgetBytes(mb * 1024 * 1024);
+
+  composeCache_.setBudgetBytes(kComposeBudgetBytes);
+
+  loader_ = new FrameLoader(this);
+  connect(loader_, &FrameLoader::decoded, this, &ModeManager::onFrameDecoded);
+  // a broken PNG would otherwise be queued again on every repaint
+  connect(loader_, &FrameLoader::failed, this, [this](const QString& path){ failed_.insert(path); });
+
+  catalog_.load();                                // stale/missing is fine: rebuilt per folder
+
   QString exe = QCoreApplication::applicationDirPath();
   QString cwd = QDir::currentPath();
   setSearchRoots({ exe + "/ui/assets/modes", cwd + "/ui/assets/modes" });
 }
 
+ModeManager::~ModeManager() {
+  if (!usingPack()) catalog_.updateInfos(currentModeDir_, frameIndex_, listedFrames_);
+  catalog_.save();
+}
+
 void ModeManager::setSearchRoots(const QStringList& roots) {
   searchRoots_.clear();
   for (const auto& r : roots) {
@@ -44,22 +68,35 @@ void ModeManager::setSearchRoots(const QStringList& roots) {
 void ModeManager::refreshModes() {
   modes_.clear();
   for (const auto& root : searchRoots_) {
-    QDir d(root);
-    const QFileInfoList dirs = d.entryInfoList(QDir::Dirs|QDir::NoDotAndDotDot, QDir::Name);
-    for (const QFileInfo& fi : dirs) {
-      const QString name = fi.fileName();
+    // cached listing unless the root folder changed
+    for (const QString& name : catalog_.modesUnder(root)) {
       if (!modes_.contains(name)) modes_ << name;
     }
   }
+  catalog_.save();
 }
 
 QStringList ModeManager::listModes() const { return modes_; }
 
 bool ModeManager::setMode(const QString& name) {
   if (!modes_.contains(name)) return false;
+  loader_->cancelPending();                       // old mode's backlog is no longer urgent
+  failed_.clear();                                // fixed on disk meanwhile? try again
+  if (!currentModeDir_.isEmpty() && !usingPack())
+    catalog_.updateInfos(currentModeDir_, frameIndex_, listedFrames_);
   if (!loadFramesForMode(name)) return false;
   currentMode_ = name;
   index_ = 0;
+
+  // first frame ASAP, then the whole mode in the background; the emotion
+  // controller bumps its sum.json frames from the modeChanged handler
+  // (pack frames are mapped, not decoded: nothing to prefetch)
+  if (!usingPack()) {
+    if (!frames_.isEmpty()) loader_->request(frames_.first(), FrameLoader::Current);
+    for (const auto& path : frames_)
+      if (!cache_.contains(path)) loader_->request(path, FrameLoader::Background);
+  }
+
   emit modeChanged(currentMode_);
   emit frameChanged(index_);
   return true;
@@ -72,55 +109,185 @@ void ModeManager::nextFrame() {
 }
 
 QImage ModeManager::currentImage() const {
-  if (frames_.isEmpty() || index_ < 0 || index_ >= frames_.size()) return QImage();
-  return QImage(frames_.at(index_));
+  return imageAt(index_);
+}
+
+QImage ModeManager::imageAt(int index) const {
+  if (frames_.isEmpty() || index < 0 || index >= frames_.size()) return QImage();
+  if (index < pack_.frameCount()) {
+    // raw pack frames: wrap the mapping once, no pixel copy at all
+    if (pack_.isZeroCopy(index)) {
+      QImage& img = packImages_[index];
+      if (img.isNull()) {
+        img = pack_.image(index);
+        frameIndex_.setHitMask(index, FrameIndex::hitMask(img));   // once per mode load
+      }
+      return img;
+    }
+    const QString& path = frames_.at(index);
+    const int base = pack_.baseIndex(index);
+    if (base < 0) {
+      // LZ4 whole frame: inflated once into the budgeted frame cache, like a
+      // decoded PNG (cycling a mode must not inflate it again every pass)
+      QImage img = cache_.find(path);
+      if (img.isNull()) {
+        img = pack_.payload(index);
+        if (img.isNull()) return img;
+        cache_.insert(path, img);
+        if (!frameIndex_.value(index).maskKnown)
+          frameIndex_.setHitMask(index, FrameIndex::hitMask(img));
+      }
+      return img;
+    }
+    // base + face patch: the base comes mapped or from cache_ (above), the
+    // patch is a row copy. Only the last few composites are kept around.
+    QImage img = composeCache_.find(path);
+    if (img.isNull()) {
+      const QImage baseImg = imageAt(base);
+      if (baseImg.isNull()) return baseImg;
+      img = baseImg.copy();                        // detach from the mapping / cached base
+      SpritePack::blitPatch(img, pack_.payload(index), pack_.patchRect(index).topLeft());
+      composeCache_.insert(path, img);
+      if (!frameIndex_.value(index).maskKnown)
+        frameIndex_.setHitMask(index, FrameIndex::hitMask(img));
+    }
+    return img;
+  }
+
+  const QString& path = frames_.at(index);
+  const QImage img = cache_.find(path);
+  if (img.isNull() && !failed_.contains(path))
+    loader_->request(path, FrameLoader::Current);  // imageReady follows
+  return img;
+}
+
+void ModeManager::prefetchBasenames(const QStringList& basenames) {
+  for (const auto& bn : basenames) {
+    const QString path = currentModeDir_ + "/" + bn + ".png";
+    const int i = indexOfPath(path);
+    if (i >= pack_.frameCount() && !cache_.contains(path) && !failed_.contains(path))
+      loader_->request(path, FrameLoader::Emotion);
+  }
+}
+
+void ModeManager::onFrameDecoded(const QString& path, const QImage& img,
+                                 const QRect& opaque, const QRegion& mask) {
+  cache_.insert(path, img);
+  const int i = indexOfPath(path);
+  if (i < 0) return;                              // decoded for a previous mode
+
+  const QRect before = cropRect();
+  if (!frameIndex_.value(i).opaqueKnown) frameIndex_.setOpaqueRect(i, opaque);
+  if (!frameIndex_.value(i).maskKnown)   frameIndex_.setHitMask(i, mask);
+  emit imageReady(i);
+
+  const QRect after = cropRect();
+  if (after != before) {
+    emit cropChanged(after);
+    // every box of the mode is known now: next start sizes the window right away
+    // (written on a pool thread: this runs between decodes on the GUI thread)
+    catalog_.updateInfos(currentModeDir_, frameIndex_, listedFrames_);
+    catalog_.saveInBackground();
+  }
 }
 
 bool ModeManager::loadFramesForMode(const QString& name) {
+  pack_.close();
+  packImages_.clear();
+  composeCache_.clear();
+  emotions_.clear();
   for (const auto& root : searchRoots_) {
     const QString modeDir = root + "/" + name;
-    QDir d(modeDir);
-    if (!d.exists()) continue;
-    currentModeDir_ = d.absolutePath();            // <-- NEW
-    frames_ = findPngs(currentModeDir_);
+    const ModeCatalog::ModeRecord* rec = catalog_.mode(modeDir);   // stat, re-scan only if changed
+    if (!rec) continue;
+    currentModeDir_ = modeDir;                     // roots are already absolute
+    if (loadFramesFromPack(currentModeDir_)) {
+      rebuildLookup();
+      emotions_ = pack_.emotionJson().isEmpty() ? rec->emotions
+                                                : ModeCatalog::parseEmotionJson(pack_.emotionJson());
+      listedFrames_ = frames_.size();
+      catalog_.save();
+      return true;
+    }
+    frames_.clear();
+    frames_.reserve(rec->frames.size());
+    for (const auto& f : rec->frames) frames_ << currentModeDir_ + "/" + f;
+    frameIndex_.assign(rec->infos);                // cached headers + opaque boxes
+    emotions_ = rec->emotions;
+    listedFrames_ = frames_.size();
+    rebuildLookup();
+    catalog_.save();
     return true;
   }
   frames_.clear();
+  frameIndex_.clear();
+  listedFrames_ = 0;
+  rebuildLookup();
   currentModeDir_.clear();                         // <-- NEW
   return false;
 }
 
-QStringList ModeManager::findPngs(const QString& dir) {
-  QDir d(dir);
-  QStringList pngs = d.entryList({ "*.png", "*.PNG" }, QDir::Files, QDir::Name);
-  QStringList out; out.reserve(pngs.size());
-  for (const auto& p : pngs) out << d.absoluteFilePath(p);
-  return out;
+bool ModeManager::loadFramesFromPack(const QString& modeDir) {
+  const QString packPath = SpritePack::fileNameFor(modeDir);
+  if (!QFileInfo::exists(packPath) || !pack_.open(packPath)) return false;
+
+  // frames keep their PNG paths so basename/path lookups work unchanged
+  const int n = pack_.frameCount();
+  frames_.clear();
+  frameIndex_.clear();
+  frames_.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    frames_ << modeDir + "/" + pack_.name(i) + ".png";
+    frameIndex_.append(FrameInfo{ pack_.size(i), pack_.opaqueRect(i), true });
+  }
+  packImages_.resize(n);
+  return true;
+}
+
+
+
+void ModeManager::rebuildLookup() {
+  basenames_.clear();
+  pathIndex_.clear();
+  basenameIndex_.clear();
+  basenames_.reserve(frames_.size());
+  pathIndex_.reserve(frames_.size());
+  basenameIndex_.reserve(frames_.size());
+  for (int i = 0; i < frames_.size(); ++i) indexFrame(i);
+}
+
+void ModeManager::indexFrame(int i) {
+  const QString& path = frames_.at(i);
+  const QString  bn   = QFileInfo(path).completeBaseName();   // once per frame, not per lookup
+  basenames_ << bn;
+  if (!pathIndex_.contains(path)) pathIndex_.insert(path, i);
+  const QString key = bn.toLower();
+  if (!basenameIndex_.contains(key)) basenameIndex_.insert(key, i);
 }
 
+int ModeManager::indexOfBasename(const QString& basename, Qt::CaseSensitivity cs) const {
+  const int i = basenameIndex_.value(basename.toLower(), -1);
+  if (i < 0 || cs == Qt::CaseInsensitive) return i;
+  if (basenames_.at(i) == basename) return i;
+  // rare: same name in another case earlier in the list
+  return basenames_.indexOf(basename);
+}
 
 bool ModeManager::setFrameByBasename(const QString& basename, Qt::CaseSensitivity cs) {
   if (basename.isEmpty() || frames_.isEmpty()) return false;
   // qDebug() << "[mode] setFrameByBasename:" << basename << " total frames =" << frames_.size();
 
-  for (int i = 0; i < frames_.size(); ++i) {
-    const QFileInfo fi(frames_.at(i));
-    const QString bn = fi.completeBaseName();
-    if (QString::compare(bn, basename, cs) == 0) {
-      // qDebug() << "   -> matched index" << i << " path =" << fi.absoluteFilePath();
-      if (index_ == i) return true;
-      index_ = i;
-      emit frameChanged(index_);
-      return true;
-    }
-  }
-  // qDebug() << "   -> no match for basename in current frames";
-  return false;
+  const int i = indexOfBasename(basename, cs);
+  if (i < 0) return false;
+  if (index_ == i) return true;
+  index_ = i;
+  emit frameChanged(index_);
+  return true;
 }
 
 bool ModeManager::setFrameByPath(const QString& absPath) {
   if (absPath.isEmpty() || frames_.isEmpty()) return false;
-  const int i = frames_.indexOf(absPath);
+  const int i = indexOfPath(absPath);
   // qDebug() << "[mode] setFrameByPath:" << absPath << " found index =" << i;
   if (i < 0) return false;
   if (index_ == i) return true;
@@ -129,16 +296,27 @@ bool ModeManager::setFrameByPath(const QString& absPath) {
   return true;
 }
 
-bool ModeManager::ensureAndSetFramePath(const QString& absPath) {
-  if (absPath.isEmpty()) return false;
-  int i = frames_.indexOf(absPath);
+bool ModeManager::setFrame(int index) {
+  if (index < 0 || index >= frames_.size()) return false;
+  if (index_ == index) return true;
+  index_ = index;
+  emit frameChanged(index_);
+  return true;
+}
+
+int ModeManager::appendFrame(const QString& absPath) {
+  if (absPath.isEmpty()) return -1;
+  int i = indexOfPath(absPath);
   if (i < 0) {
-    // qDebug() << "[mode] ensureAndSetFramePath: appending" << absPath;
+    // qDebug() << "[mode] appendFrame:" << absPath;
     frames_ << absPath;
+    frameIndex_.append(absPath);
     i = frames_.size() - 1;
+    indexFrame(i);
   }
-  if (index_ == i) return true;
-  index_ = i;
-  emit frameChanged(index_);
-  return true;
-}
\ No newline at end of file
+  return i;
+}
+
+bool ModeManager::ensureAndSetFramePath(const QString& absPath) {
+  return setFrame(appendFrame(absPath));
+}
@@ -6,12 +6,22 @@
 #pragma once
 #include <QObject>
 #include <QImage>
+#include <QHash>
+#include <QSet>
 #include <QStringList>
+#include "FrameCache.h"
+#include "FrameIndex.h"
+#include "ModeCatalog.h"
+#include "SpritePack.h"
+#include <QVector>
+
+class FrameLoader;
 
 class ModeManager : public QObject {
   Q_OBJECT
 public:
   explicit ModeManager(QObject* parent=nullptr);
+  ~ModeManager() override;
 
   void setSearchRoots(const QStringList& roots);
   QStringList listModes() const;
@@ -22,7 +32,35 @@ public:
   void nextFrame();
   int  frameCount() const { return frames_.size(); }
   int  currentIndex() const { return index_; }
-  QImage currentImage() const;
+  // Never decodes on the caller's thread: a cache miss queues a background
+  // decode and returns a null image (draw a placeholder until imageReady).
+  QImage currentImage() const;            // served from frameCache()
+  QImage imageAt(int index) const;
+
+  // mode was loaded from <mode>.lunapack (see tools/luna_pack.cpp)
+  bool       usingPack() const { return pack_.isOpen(); }
+  // sum.json embedded in the pack (empty without a pack); valid until the next setMode
+  QByteArray packEmotionJson() const { return pack_.emotionJson(); }
+
+  // parsed emotion map of the current mode ("<E:smile>" -> basenames), from
+  // the pack or the catalog; no file access after the first run
+  const QHash<QString, QStringList>& emotionMap() const { return emotions_; }
+
+  // warm the cache for these frames of the current mode (sum.json order)
+  void prefetchBasenames(const QStringList& basenames);
+
+  // per-mode geometry index (PNG headers only); O(1), never decodes
+  const FrameIndex& frameIndex() const { return frameIndex_; }
+  FrameInfo frameInfo(int index) const { return frameIndex_.value(index); }
+  QSize     currentFrameSize() const   { return frameIndex_.value(index_).size; }
+  // union of the mode's opaque boxes; sprites are cropped to this
+  QRect     cropRect() const           { return frameIndex_.unionOpaqueRect(); }
+  // clickable area of the current frame in canvas coords (null until known)
+  QRegion   currentHitMask() const     { return frameIndex_.value(index_).hitMask; }
+
+  // shared decoded-frame cache (LRU, byte budget, hit/miss counters)
+  FrameCache&       frameCache()       { return cache_; }
+  const FrameCache& frameCache() const { return cache_; }
 
   // --- NEW: allow external code to pick a concrete PNG as the "current frame"
   // basename = file name without extension (e.g., "lun_s_1_0_03")
@@ -30,6 +68,12 @@ public:
                           Qt::CaseSensitivity cs = Qt::CaseInsensitive);
   // optional convenience: set by absolute file path
   bool setFrameByPath(const QString& absPath);
+  // select by index into the current mode's frame list (EmotionTable output)
+  bool setFrame(int index);
+
+  // O(1) lookups (hashed, kept in sync with frames_); -1 if absent
+  int indexOfBasename(const QString& basename, Qt::CaseSensitivity cs = Qt::CaseInsensitive) const;
+  int indexOfPath(const QString& absPath) const { return pathIndex_.value(absPath, -1); }
 
   // --- NEW: expose the active mode directory (for summary.json)
   QString modeDir() const { return currentModeDir_; }
@@ -37,12 +81,18 @@ public:
 
     // NEW: ensure the path is in frames_ (append if missing) and select it
   bool ensureAndSetFramePath(const QString& absPath);
+  // same, without selecting it; returns the frame's index
+  int  appendFrame(const QString& absPath);
+
+  QStringList searchRoots() const { return searchRoots_; }
 
   // QString modeDir() const { return currentModeDir_; }
 
 signals:
   void modeChanged(const QString& name);
   void frameChanged(int index);
+  void imageReady(int index);             // a frame of the current mode finished decoding
+  void cropChanged(const QRect& crop);    // every frame's box is known -> tighter crop
 
 private:
   QStringList searchRoots_;
@@ -51,10 +101,34 @@ private:
   QStringList frames_;          // absolute PNG paths
   int         index_ = 0;
 
+  // lookup tables over frames_ (first occurrence wins, like the old scans)
+  QStringList         basenames_;       // completeBaseName per frame
+  QHash<QString, int> pathIndex_;       // abs path -> index
+  QHash<QString, int> basenameIndex_;   // lower-cased basename -> index
+
   // --- NEW
   QString     currentModeDir_;
 
+  mutable FrameCache cache_;
+  mutable FrameIndex frameIndex_;   // opaque boxes filled lazily on decode
+  FrameLoader*       loader_ = nullptr;
+  QSet<QString>      failed_;      // didn't decode: not requested again until setMode
+
+  SpritePack              pack_;
+  mutable QVector<QImage> packImages_;   // zero-copy wrappers, stable cacheKey()
+  mutable FrameCache      composeCache_; // few recently shown base+patch composites
+
+  ModeCatalog                 catalog_;
+  QHash<QString, QStringList> emotions_;
+  int                         listedFrames_ = 0;   // frames_ that came from the folder/catalog
+
+  void onFrameDecoded(const QString& path, const QImage& img,
+                      const QRect& opaque, const QRegion& mask);
+
+  void rebuildLookup();
+  void indexFrame(int i);
+
   void refreshModes();
   bool loadFramesForMode(const QString& name);
-  static QStringList findPngs(const QString& dir);
+  bool loadFramesFromPack(const QString& modeDir);
 };
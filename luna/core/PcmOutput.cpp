@@ -0,0 +1,127 @@
+/*
+
+PcmOutput
+
+Plays PCM straight from the network: no temp file, no second fetch, no
+media framework demux. Chunks are written to the sink as soon as it has
+room; clips of one utterance are appended back to back, so the only gap is
+whatever the TTS hasn't produced yet.
+
+drained() = end of stream was signalled, everything was written and the
+sink went idle (its buffer ran out).
+
+*/
+
+#include "PcmOutput.h"
+#include "LatencyTrace.h"
+#include <QAudioSink>
+#include <QMediaDevices>
+#include <QAudioDevice>
+#include <QTimer>
+
+// ~how often we top up the sink while data is waiting
+static constexpr int kPumpMs = 10;
+// sink buffer, in ms of audio: small enough to start fast, big enough not to underrun
+static constexpr int kSinkBufferMs = 200;
+
+PcmOutput::PcmOutput(QObject* parent) : QObject(parent) {
+  pump_ = new QTimer(this);
+  pump_->setInterval(kPumpMs);
+  connect(pump_, &QTimer::timeout, this, &PcmOutput::pump);
+}
+
+PcmOutput::~PcmOutput() {
+  if (sink_) sink_->stop();
+}
+
+bool PcmOutput::begin(int sampleRate, int channels) {
+  QAudioFormat f;
+  f.setSampleRate(sampleRate > 0 ? sampleRate : 32000);
+  f.setChannelCount(channels > 0 ? channels : 1);
+  f.setSampleFormat(QAudioFormat::Int16);
+
+  pending_.clear();
+  ended_  = false;
+  active_ = true;
+
+  if (sink_ && f == fmt_ && sink_->state() != QAudio::StoppedState) return true;
+
+  if (sink_) { QAudioSink* old = sink_; sink_ = nullptr; dev_ = nullptr; old->stop(); old->deleteLater(); }
+  const QAudioDevice out = QMediaDevices::defaultAudioOutput();
+  if (out.isNull() || !out.isFormatSupported(f)) {
+    active_ = false;
+    emit error(QStringLiteral("Audio: PCM format not supported"));
+    return false;
+  }
+
+  fmt_  = f;
+  sink_ = new QAudioSink(out, f, this);
+  sink_->setBufferSize(f.bytesForDuration(qint64(kSinkBufferMs) * 1000));
+  sink_->setVolume(volume_);
+  QAudioSink* sink = sink_;
+  connect(sink, &QAudioSink::stateChanged, this, [this, sink](QAudio::State st){
+    if (sink != sink_) return;        // an old sink winding down
+    if (st == QAudio::StoppedState && sink->error() != QAudio::NoError
+        && sink->error() != QAudio::UnderrunError) {
+      active_ = false;
+      emit error(QStringLiteral("Audio: sink error %1").arg(int(sink->error())));
+      return;
+    }
+    if (st == QAudio::ActiveState) LatencyTrace::mark(LatencyTrace::FirstSample);
+    // underrun: either the next clause isn't here yet, or we're done
+    if (st == QAudio::IdleState && ended_ && !hasPending()) finish();
+  });
+  dev_ = sink_->start();
+  return dev_ != nullptr;
+}
+
+void PcmOutput::append(const QByteArray& pcm) {
+  if (!active_ || pcm.isEmpty()) return;
+  pending_ += pcm;
+  pump();
+}
+
+void PcmOutput::endOfStream() {
+  if (!active_) return;
+  ended_ = true;
+  if (!hasPending() && (!sink_ || sink_->state() != QAudio::ActiveState)) finish();
+}
+
+void PcmOutput::stop() {
+  pump_->stop();
+  pending_.clear();
+  active_ = false;
+  ended_  = false;
+  if (sink_) {                        // drop buffered audio; begin() opens a new one
+    QAudioSink* old = sink_;
+    sink_ = nullptr;
+    dev_  = nullptr;
+    old->stop();
+    old->deleteLater();
+  }
+}
+
+void PcmOutput::setVolume(qreal v) {
+  volume_ = v;
+  if (sink_) sink_->setVolume(v);
+}
+
+void PcmOutput::pump() {
+  if (!dev_ || !sink_) return;
+  const int frame = qMax(1, fmt_.bytesPerFrame());
+  qint64 n = qMin<qint64>(sink_->bytesFree(), pending_.size());
+  n -= n % frame;                     // whole frames only; the tail waits for its other half
+  if (n > 0) {
+    const qint64 w = dev_->write(pending_.constData(), n);
+    if (w > 0) pending_.remove(0, int(w));
+  }
+  if (hasPending()) { if (!pump_->isActive()) pump_->start(); }
+  else pump_->stop();
+}
+
+void PcmOutput::finish() {
+  pump_->stop();
+  active_ = false;
+  ended_  = false;
+  emit drained();
+}
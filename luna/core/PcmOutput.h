@@ -0,0 +1,48 @@
+// PcmOutput.h
+
+/*
+  QAudioSink fed with raw s16le PCM as it arrives (push mode)
+*/
+
+#pragma once
+#include <QObject>
+#include <QAudioFormat>
+#include <QByteArray>
+
+class QAudioSink;
+class QIODevice;
+class QTimer;
+
+class PcmOutput : public QObject {
+  Q_OBJECT
+public:
+  explicit PcmOutput(QObject* parent=nullptr);
+  ~PcmOutput() override;
+
+  // start an utterance; keeps the open sink when the format is unchanged
+  bool begin(int sampleRate, int channels);
+  void append(const QByteArray& pcm);   // any size; split samples are fine
+  void endOfStream();                   // drained() once the last sample played
+  void stop();
+
+  bool isActive() const { return active_; }
+  void setVolume(qreal v);
+
+signals:
+  void drained();
+  void error(const QString& msg);
+
+private:
+  QAudioSink*  sink_ = nullptr;
+  QIODevice*   dev_  = nullptr;       // sink's push device
+  QAudioFormat fmt_;
+  QByteArray   pending_;              // not yet accepted by the sink
+  QTimer*      pump_ = nullptr;
+  qreal        volume_ = 0.8;
+  bool         active_ = false;
+  bool         ended_  = false;
+
+  void pump();
+  void finish();
+  bool hasPending() const { return pending_.size() >= qMax(1, fmt_.bytesPerFrame()); }
+};
@@ -0,0 +1,314 @@
+/*
+
+SpritePack
+
+Written offline by the luna_pack tool, read by ModeManager. Opening a pack
+is a single mmap: the index, emotion map and raw frames are used in place,
+so a mode switch needs neither a directory scan nor PNG inflate.
+
+Frames of one pose (lun_s_M_P_*) share body and outfit and differ only
+around the face, so v2 packs store one full base per pose plus a patch per
+frame. Patches are cut from the flattened frames, i.e. they are exact
+replacement pixels: compositing is a row copy, not a blend.
+
+*/
+
+#include "SpritePack.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <cstring>
+
+#ifdef LUNA_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+using namespace lunapack;
+
+struct SpritePack::Mapping {
+  QFile  file;
+  uchar* data = nullptr;
+  qint64 size = 0;
+  ~Mapping() { if (data) file.unmap(data); }
+};
+
+// QImage cleanup hook: drops the image's reference to the mapping
+static void releaseMapping(void* info) {
+  delete static_cast<std::shared_ptr<void>*>(info);
+}
+
+static quint64 alignUp(quint64 v) { return (v + kPackAlign - 1) & ~(kPackAlign - 1); }
+
+QString SpritePack::fileNameFor(const QString& modeDir) {
+  const QDir d(modeDir);
+  return d.absoluteFilePath(d.dirName() + QStringLiteral(".lunapack"));
+}
+
+bool SpritePack::lz4Available() {
+#ifdef LUNA_HAVE_LZ4
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool SpritePack::open(const QString& path) {
+  close();
+  auto m = std::make_shared<Mapping>();
+  m->file.setFileName(path);
+  if (!m->file.open(QIODevice::ReadOnly)) return false;
+  m->size = m->file.size();
+  if (m->size < qint64(sizeof(PackHeader))) return false;
+  m->data = m->file.map(0, m->size);
+  if (!m->data) return false;
+
+  const auto* h = reinterpret_cast<const PackHeader*>(m->data);
+  if (std::memcmp(h->magic, kMagic, sizeof kMagic) != 0) return false;
+  if (h->version != kVersion || h->byteOrder != kByteOrder) return false;
+
+  const quint64 indexEnd = h->indexOffset + quint64(h->frameCount) * sizeof(PackEntry);
+  if (indexEnd > quint64(m->size)) return false;
+  if (h->emotionOffset + h->emotionSize > quint64(m->size)) return false;
+
+  const auto* e = reinterpret_cast<const PackEntry*>(m->data + h->indexOffset);
+  for (quint32 i = 0; i < h->frameCount; ++i) {
+    if (e[i].offset + e[i].storedSize > quint64(m->size)) return false;
+    const bool patch = e[i].baseIndex >= 0;
+    if (patch) {
+      // bases are always full frames; patches stay inside the canvas
+      if (quint32(e[i].baseIndex) >= h->frameCount || e[e[i].baseIndex].baseIndex >= 0) return false;
+      const QRect canvas(0, 0, int(e[i].width), int(e[i].height));
+      const QRect pr(e[i].patchX, e[i].patchY, e[i].patchW, e[i].patchH);
+      if (!pr.isEmpty() && !canvas.contains(pr)) return false;
+    }
+    const quint32 rows = patch ? quint32(qMax(0, e[i].patchH)) : e[i].height;
+    const quint32 cols = patch ? quint32(qMax(0, e[i].patchW)) : e[i].width;
+    // a stride shorter than a row (or unaligned) would make QImage read past
+    // the mapping; luna_pack never writes one, a corrupt/hand-made pack might
+    if (quint64(e[i].bytesPerLine) < quint64(cols) * 4 || e[i].bytesPerLine % 4 != 0) return false;
+    if (e[i].codec == Raw &&
+        (e[i].storedSize < quint64(e[i].bytesPerLine) * rows || e[i].offset % 4 != 0)) return false;
+  }
+
+  map_     = std::move(m);
+  header_  = h;
+  entries_ = e;
+  return true;
+}
+
+void SpritePack::close() {
+  map_.reset();      // images still referencing it keep their own reference
+  header_  = nullptr;
+  entries_ = nullptr;
+}
+
+const PackEntry* SpritePack::entry(int i) const {
+  if (!entries_ || i < 0 || i >= int(header_->frameCount)) return nullptr;
+  return entries_ + i;
+}
+
+QString SpritePack::name(int i) const {
+  const PackEntry* e = entry(i);
+  if (!e) return {};
+  return QString::fromUtf8(e->name, int(qstrnlen(e->name, kNameBytes)));
+}
+
+QSize SpritePack::size(int i) const {
+  const PackEntry* e = entry(i);
+  return e ? QSize(int(e->width), int(e->height)) : QSize();
+}
+
+QRect SpritePack::opaqueRect(int i) const {
+  const PackEntry* e = entry(i);
+  return e ? QRect(e->opaqueX, e->opaqueY, e->opaqueW, e->opaqueH) : QRect();
+}
+
+bool SpritePack::isZeroCopy(int i) const {
+  const PackEntry* e = entry(i);
+  return e && e->codec == Raw && e->baseIndex < 0;
+}
+
+int SpritePack::baseIndex(int i) const {
+  const PackEntry* e = entry(i);
+  return e ? e->baseIndex : -1;
+}
+
+QRect SpritePack::patchRect(int i) const {
+  const PackEntry* e = entry(i);
+  if (!e || e->baseIndex < 0) return QRect();
+  return QRect(e->patchX, e->patchY, e->patchW, e->patchH);
+}
+
+QByteArray SpritePack::emotionJson() const {
+  if (!header_ || header_->emotionSize == 0) return {};
+  // fromRawData: no copy, valid while the mapping is
+  return QByteArray::fromRawData(reinterpret_cast<const char*>(map_->data + header_->emotionOffset),
+                                 qsizetype(header_->emotionSize));
+}
+
+QImage SpritePack::image(int i) const {
+  const PackEntry* e = entry(i);
+  if (!e) return QImage();
+  if (e->baseIndex < 0) return payload(i);
+
+  // base + face patch; copy() detaches from the (read-only) mapping
+  QImage out = payload(e->baseIndex).copy();
+  if (out.isNull()) return out;
+  blitPatch(out, payload(i), QPoint(e->patchX, e->patchY));
+  return out;
+}
+
+QImage SpritePack::payload(int i) const {
+  const PackEntry* e = entry(i);
+  if (!e || e->storedSize == 0) return QImage();
+  const uchar* data  = map_->data + e->offset;
+  const bool   patch = e->baseIndex >= 0;
+  const int w = patch ? e->patchW : int(e->width);
+  const int h = patch ? e->patchH : int(e->height);
+  if (w <= 0 || h <= 0) return QImage();
+
+  if (e->codec == Raw) {
+    auto* ref = new std::shared_ptr<void>(map_);
+    return QImage(data, w, h, qsizetype(e->bytesPerLine),
+                  QImage::Format_ARGB32_Premultiplied, releaseMapping, ref);
+  }
+
+#ifdef LUNA_HAVE_LZ4
+  if (e->codec == Lz4) {
+    QImage img(w, h, QImage::Format_ARGB32_Premultiplied);
+    if (img.isNull() || img.bytesPerLine() != qsizetype(e->bytesPerLine)) return QImage();
+    const int n = LZ4_decompress_safe(reinterpret_cast<const char*>(data),
+                                      reinterpret_cast<char*>(img.bits()),
+                                      int(e->storedSize), int(img.sizeInBytes()));
+    if (n != int(img.sizeInBytes())) return QImage();
+    return img;
+  }
+#endif
+  return QImage();
+}
+
+void SpritePack::blitPatch(QImage& dst, const QImage& patch, const QPoint& at) {
+  if (dst.isNull() || patch.isNull()) return;
+  const QRect r = QRect(at, patch.size()).intersected(dst.rect());
+  if (r.isEmpty()) return;
+  const int    sx    = r.x() - at.x();
+  const int    sy    = r.y() - at.y();
+  const size_t bytes = size_t(r.width()) * sizeof(QRgb);
+  for (int y = 0; y < r.height(); ++y) {
+    const uchar* src = patch.constScanLine(sy + y) + sx * sizeof(QRgb);
+    uchar*       out = dst.scanLine(r.y() + y) + r.x() * sizeof(QRgb);
+    std::memcpy(out, src, bytes);     // exact replacement pixels
+  }
+}
+
+QRect SpritePack::diffRect(const QImage& a, const QImage& b) {
+  if (a.size() != b.size() || a.format() != b.format()) return a.rect();
+  const int    w     = a.width();
+  const int    h     = a.height();
+  const size_t bytes = size_t(w) * sizeof(QRgb);
+  auto rowDiffers = [&](int y) { return std::memcmp(a.constScanLine(y), b.constScanLine(y), bytes) != 0; };
+
+  int top = 0;
+  while (top < h && !rowDiffers(top)) ++top;
+  if (top == h) return QRect();                // identical
+  int bottom = h - 1;
+  while (bottom > top && !rowDiffers(bottom)) --bottom;
+
+  int left = w, right = -1;
+  for (int y = top; y <= bottom; ++y) {
+    const QRgb* la = reinterpret_cast<const QRgb*>(a.constScanLine(y));
+    const QRgb* lb = reinterpret_cast<const QRgb*>(b.constScanLine(y));
+    for (int x = 0; x < left; ++x)      if (la[x] != lb[x]) { left = x; break; }
+    for (int x = w - 1; x > right; --x) if (la[x] != lb[x]) { right = x; break; }
+  }
+  return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+bool SpritePack::write(const QString& path, const QVector<Frame>& frames,
+                       const QByteArray& emotionJson, bool useLz4, QString* err) {
+  auto fail = [err](const QString& msg) { if (err) *err = msg; return false; };
+#ifndef LUNA_HAVE_LZ4
+  if (useLz4) return fail(QStringLiteral("built without LZ4 support"));
+#endif
+
+  PackHeader h{};
+  std::memcpy(h.magic, kMagic, sizeof kMagic);
+  h.version       = kVersion;
+  h.byteOrder     = kByteOrder;
+  h.frameCount    = quint32(frames.size());
+  h.indexOffset   = sizeof(PackHeader);
+  h.emotionOffset = h.indexOffset + quint64(frames.size()) * sizeof(PackEntry);
+  h.emotionSize   = quint64(emotionJson.size());
+
+  QVector<PackEntry>  entries(frames.size());
+  QVector<QByteArray> payloads(frames.size());
+  quint64 cursor = alignUp(h.emotionOffset + h.emotionSize);
+
+  QVector<QImage> images(frames.size());
+  for (int i = 0; i < frames.size(); ++i) {
+    images[i] = frames.at(i).image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    if (images[i].isNull()) return fail(QStringLiteral("null image: %1").arg(frames.at(i).name));
+  }
+
+  for (int i = 0; i < frames.size(); ++i) {
+    const Frame& f = frames.at(i);
+    QImage img = images.at(i);
+    const QByteArray nameUtf8 = f.name.toUtf8();
+    if (nameUtf8.size() >= kNameBytes) return fail(QStringLiteral("name too long: %1").arg(f.name));
+
+    PackEntry& e = entries[i];
+    std::memcpy(e.name, nameUtf8.constData(), size_t(nameUtf8.size()));
+    e.width        = quint32(img.width());
+    e.height       = quint32(img.height());
+    e.bytesPerLine = quint32(img.bytesPerLine());
+    e.opaqueX = f.opaqueRect.x();     e.opaqueY = f.opaqueRect.y();
+    e.opaqueW = f.opaqueRect.width(); e.opaqueH = f.opaqueRect.height();
+    e.baseIndex = -1;
+
+    // face patch against the pose base, unless it would not save much
+    if (f.base >= 0 && f.base < frames.size() && f.base != i && frames.at(f.base).base < 0
+        && images.at(f.base).size() == img.size()) {
+      const QRect d = diffRect(img, images.at(f.base));
+      const double share = double(d.width()) * d.height() / (double(img.width()) * img.height());
+      if (share <= kMaxPatchShare) {
+        e.baseIndex = f.base;
+        e.patchX = d.x(); e.patchY = d.y(); e.patchW = d.width(); e.patchH = d.height();
+        img = d.isEmpty() ? QImage() : img.copy(d);
+        e.bytesPerLine = img.isNull() ? 0 : quint32(img.bytesPerLine());
+      }
+    }
+
+    const char* src = img.isNull() ? nullptr : reinterpret_cast<const char*>(img.constBits());
+    const int   len = img.isNull() ? 0 : int(img.sizeInBytes());
+    e.codec = Raw;
+    payloads[i] = QByteArray(src, len);
+#ifdef LUNA_HAVE_LZ4
+    if (useLz4 && len > 0) {
+      QByteArray packed(LZ4_compressBound(len), Qt::Uninitialized);
+      const int n = LZ4_compress_default(src, packed.data(), len, int(packed.size()));
+      if (n > 0 && n < len) { packed.truncate(n); payloads[i] = packed; e.codec = Lz4; }
+    }
+#endif
+    e.offset     = cursor;
+    e.storedSize = quint64(payloads[i].size());
+    cursor = alignUp(cursor + e.storedSize);
+  }
+
+  QSaveFile out(path);
+  if (!out.open(QIODevice::WriteOnly)) return fail(out.errorString());
+  auto pad = [&out](quint64 to) {
+    const qint64 n = qint64(to) - out.pos();
+    if (n > 0) out.write(QByteArray(n, '\0'));
+  };
+  out.write(reinterpret_cast<const char*>(&h), sizeof h);
+  out.write(reinterpret_cast<const char*>(entries.constData()),
+            qint64(entries.size()) * qint64(sizeof(PackEntry)));
+  out.write(emotionJson);
+  for (int i = 0; i < payloads.size(); ++i) {
+    pad(entries[i].offset);
+    out.write(payloads[i]);
+  }
+  if (!out.commit()) return fail(out.errorString());
+  return true;
+}
@@ -0,0 +1,118 @@
+// SpritePack.h
+
+/*
+  One-file-per-mode sprite pack: index + sum.json + premultiplied ARGB32 frames (mmap)
+*/
+#pragma once
+#include <QByteArray>
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <QString>
+#include <QVector>
+#include <memory>
+
+// ---- On-disk layout (host byte order; packs are built on the target machine) ----
+//
+//   PackHeader
+//   PackEntry[frameCount]               at header.indexOffset
+//   emotion JSON (sum.json bytes)       at header.emotionOffset
+//   frame payloads, each kPackAlign-aligned
+//
+// v2: a frame may be a face patch over a per-pose base frame (baseIndex >= 0).
+// Its payload is then only the patchW x patchH region that differs from the
+// base; the full frame is base + patch, composited on demand.
+//
+namespace lunapack {
+
+constexpr char     kMagic[8]   = { 'L','U','N','A','P','A','K','\0' };
+constexpr quint32  kVersion    = 2;
+constexpr quint32  kByteOrder  = 0x01020304;
+constexpr quint64  kPackAlign  = 64;
+constexpr int      kNameBytes  = 48;
+
+enum Codec : quint32 { Raw = 0, Lz4 = 1 };
+
+struct PackHeader {
+  char    magic[8];
+  quint32 version;
+  quint32 byteOrder;
+  quint32 frameCount;
+  quint32 reserved;
+  quint64 indexOffset;
+  quint64 emotionOffset;
+  quint64 emotionSize;
+};
+static_assert(sizeof(PackHeader) == 48, "PackHeader layout");
+
+struct PackEntry {
+  char    name[kNameBytes];   // basename, UTF-8, NUL padded
+  quint32 width;
+  quint32 height;
+  quint32 bytesPerLine;       // of the decoded frame
+  quint32 codec;              // Codec
+  quint64 offset;             // payload offset in file
+  quint64 storedSize;         // payload bytes on disk
+  qint32  opaqueX, opaqueY, opaqueW, opaqueH;
+  qint32  baseIndex;          // -1: full frame; else index of the pose base
+  qint32  patchX, patchY, patchW, patchH;   // patch rect in canvas coords
+  quint32 reserved[3];
+};
+static_assert(sizeof(PackEntry) == 128, "PackEntry layout");
+
+} // namespace lunapack
+
+class SpritePack {
+public:
+  // compiler-side frame description
+  struct Frame {
+    QString name;     // basename without extension
+    QImage  image;    // converted to premultiplied ARGB32 on write
+    QRect   opaqueRect;
+    int     base = -1;  // index of a full frame of the same pose to diff against
+  };
+
+  // a patch bigger than this share of the canvas is stored as a full frame
+  static constexpr double kMaxPatchShare = 0.5;
+
+  SpritePack() = default;
+
+  static QString fileNameFor(const QString& modeDir);   // <modeDir>/<mode>.lunapack
+  static bool    lz4Available();
+
+  bool open(const QString& path);
+  void close();
+  bool isOpen() const { return map_ != nullptr; }
+
+  int        frameCount() const { return entries_ ? int(header_->frameCount) : 0; }
+  QString    name(int i) const;
+  QSize      size(int i) const;
+  QRect      opaqueRect(int i) const;
+  bool       isZeroCopy(int i) const;
+  int        baseIndex(int i) const;          // -1 unless i is a face patch
+  QRect      patchRect(int i) const;
+  QByteArray emotionJson() const;
+
+  // Raw frames wrap the mapping directly (read-only, zero-copy); the mapping
+  // stays alive until the last QImage referencing it is gone. LZ4 frames are
+  // inflated into a fresh heap image. Patch frames come back composited.
+  QImage image(int i) const;
+  // just the stored payload: the full frame, or the patch of a patch frame
+  QImage payload(int i) const;
+
+  // copy `patch` into `dst` at `at` (both premultiplied ARGB32)
+  static void blitPatch(QImage& dst, const QImage& patch, const QPoint& at);
+  // bounding box of pixels that differ between two same-size frames
+  static QRect diffRect(const QImage& a, const QImage& b);
+
+  static bool write(const QString& path, const QVector<Frame>& frames,
+                    const QByteArray& emotionJson, bool useLz4, QString* err = nullptr);
+
+private:
+  struct Mapping;
+  std::shared_ptr<Mapping> map_;
+  const lunapack::PackHeader* header_  = nullptr;
+  const lunapack::PackEntry*  entries_ = nullptr;
+
+  const lunapack::PackEntry* entry(int i) const;
+};
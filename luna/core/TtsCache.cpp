@@ -0,0 +1,235 @@
+/*
+
+TtsCache
+
+Luna says the same greetings and stock lines a lot; each clause is keyed by
+SHA-1 of (text, text_lang, reference voice, sampling params) and kept as a
+plain 16-bit WAV, so a repeat never reaches the TTS server.
+
+The index (key -> size, last use) is a QDataStream file next to the WAVs,
+loaded once at startup; least recently used files go first when the total
+is over the cap. A file that disappeared behind our back is just a miss.
+
+Disk work never runs on the GUI thread: WAV writes, evictions and index
+saves go, in order, to a one-thread pool. Until its write lands a clause
+is served from the bytes kept in pending_. The index is written every
+kSaveEvery stores and by save() at exit; a crash in between only leaves
+a few unindexed files behind.
+
+*/
+
+#include "TtsCache.h"
+#include "WavFile.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QStringList>
+#include <QVector>
+#include <algorithm>
+
+static constexpr quint32 kIndexMagic   = 0x4C545443;   // "LTTC"
+static constexpr quint32 kIndexVersion = 1;
+
+QDataStream& operator<<(QDataStream& s, const TtsCache::Entry& e) {
+  return s << e.bytes << e.lastUse;
+}
+QDataStream& operator>>(QDataStream& s, TtsCache::Entry& e) {
+  return s >> e.bytes >> e.lastUse;
+}
+
+TtsCache::TtsCache(const QString& dir) : dir_(dir) {
+  io_.setMaxThreadCount(1);                          // FIFO: a removal never overtakes its write
+}
+
+TtsCache::~TtsCache() {
+  io_.waitForDone();
+}
+
+QString TtsCache::defaultDir() {
+  return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/tts";
+}
+
+QString TtsCache::fileFor(const QByteArray& key) const {
+  return dir_ + "/" + QString::fromLatin1(key) + ".wav";
+}
+
+QByteArray TtsCache::key(const QString& text, const QString& lang,
+                         const QString& voice, const QString& params) {
+  QCryptographicHash h(QCryptographicHash::Sha1);
+  for (const QString* part : { &text, &lang, &voice, &params }) {
+    h.addData(part->toUtf8());
+    h.addData(QByteArrayView("\0", 1));             // field separator
+  }
+  return h.result().toHex();
+}
+
+bool TtsCache::load() {
+  QFile f(dir_ + "/index");
+  if (!f.open(QIODevice::ReadOnly)) return false;
+  QDataStream in(&f);
+  in.setVersion(QDataStream::Qt_6_0);
+
+  quint32 magic = 0, version = 0;
+  in >> magic >> version;
+  if (magic != kIndexMagic || version != kIndexVersion) return false;
+
+  QHash<QByteArray, Entry> index;
+  quint64 tick = 0;
+  in >> tick >> index;
+  if (in.status() != QDataStream::Ok) return false;   // corrupt: start over
+
+  index_ = std::move(index);
+  tick_  = tick;
+  used_  = 0;
+  for (const auto& e : std::as_const(index_)) used_ += e.bytes;
+  dirty_ = false;
+  evictTo(cap_);
+  return true;
+}
+
+bool TtsCache::save() {
+  io_.waitForDone();
+  prunePending();
+  if (!dirty_) return true;
+  if (!writeIndex(dir_, tick_, index_)) return false;
+  dirty_   = false;
+  unsaved_ = 0;
+  return true;
+}
+
+void TtsCache::saveInBackground() {
+  if (!dirty_) return;
+  dirty_   = false;                                  // a failed write only loses LRU order
+  unsaved_ = 0;
+  io_.start([dir = dir_, tick = tick_, index = index_]{ writeIndex(dir, tick, index); });
+}
+
+bool TtsCache::writeIndex(const QString& dir, quint64 tick, const QHash<QByteArray, Entry>& index) {
+  QDir().mkpath(dir);
+  QSaveFile f(dir + "/index");
+  if (!f.open(QIODevice::WriteOnly)) return false;
+  QDataStream out(&f);
+  out.setVersion(QDataStream::Qt_6_0);
+  out << kIndexMagic << kIndexVersion << tick << index;
+  return f.commit();
+}
+
+void TtsCache::prunePending() {
+  if (pending_.isEmpty()) return;
+  const quint64 written = written_.loadAcquire();
+  for (auto it = pending_.begin(); it != pending_.end(); ) {
+    if (it->seq <= written) it = pending_.erase(it);
+    else ++it;
+  }
+}
+
+bool TtsCache::lookup(const QByteArray& key, WavFile* out) {
+  auto it = index_.find(key);
+  if (it == index_.end()) { ++misses_; return false; }
+  prunePending();
+  const auto p = pending_.constFind(key);
+  if (p != pending_.cend() ? !out->parse(p->wav) : !out->read(fileFor(key))) {                  // deleted/truncated on disk
+    used_ -= it->bytes;
+    index_.erase(it);
+    dirty_ = true;
+    ++misses_;
+    return false;
+  }
+  it->lastUse = ++tick_;
+  dirty_ = true;
+  ++hits_;
+  return true;
+}
+
+bool TtsCache::lookupFile(const QByteArray& key, QString* path) {
+  auto it = index_.find(key);
+  if (it == index_.end()) { ++misses_; return false; }
+  prunePending();
+  // no file to hand out yet (same clause twice within a write): synthesize again
+  if (pending_.contains(key)) { ++misses_; return false; }
+  const QString file = fileFor(key);
+  if (!QFileInfo::exists(file)) {                  // deleted on disk
+    used_ -= it->bytes;
+    index_.erase(it);
+    dirty_ = true;
+    ++misses_;
+    return false;
+  }
+  it->lastUse = ++tick_;
+  dirty_ = true;
+  ++hits_;
+  *path = file;
+  return true;
+}
+
+void TtsCache::store(const QByteArray& key, int sampleRate, int channels, const QByteArray& pcm) {
+  if (pcm.isEmpty() || sampleRate <= 0 || channels <= 0) return;
+  if (pcm.size() + 44 > cap_) return;              // would evict everything else
+
+  QByteArray wav = WavFile::header(sampleRate, channels, quint32(pcm.size()));
+  wav += pcm;
+
+  const quint64 seq = ++queued_;
+  pending_.insert(key, Pending{ seq, wav });
+  io_.start([this, dir = dir_, file = fileFor(key), wav, seq]{
+    QDir().mkpath(dir);
+    QSaveFile f(file);
+    if (f.open(QIODevice::WriteOnly)) {            // failed: the next lookup is a miss
+      f.write(wav);
+      f.commit();
+    }
+    written_.storeRelease(seq);
+  });
+
+  const qint64 bytes = wav.size();
+  auto it = index_.find(key);
+  if (it != index_.end()) used_ -= it->bytes;
+  index_.insert(key, Entry{ bytes, ++tick_ });
+  used_ += bytes;
+  dirty_ = true;
+  evictTo(cap_);
+  prunePending();
+  if (++unsaved_ >= kSaveEvery) saveInBackground();
+}
+
+void TtsCache::clear() {
+  QStringList files;
+  for (auto it = index_.cbegin(); it != index_.cend(); ++it) files << fileFor(it.key());
+  removeFiles(files);
+  index_.clear();
+  pending_.clear();
+  used_  = 0;
+  dirty_ = true;
+  save();
+}
+
+void TtsCache::removeFiles(const QStringList& files) {
+  if (files.isEmpty()) return;
+  io_.start([files]{ for (const auto& f : files) QFile::remove(f); });
+}
+
+void TtsCache::setCapBytes(qint64 bytes) {
+  cap_ = qMax<qint64>(0, bytes);
+  evictTo(cap_);
+}
+
+void TtsCache::evictTo(qint64 bytes) {
+  if (used_ <= bytes) return;
+  QVector<QPair<quint64, QByteArray>> byAge;        // oldest first
+  byAge.reserve(index_.size());
+  for (auto it = index_.cbegin(); it != index_.cend(); ++it) byAge.push_back({ it->lastUse, it.key() });
+  std::sort(byAge.begin(), byAge.end());
+  QStringList files;
+  for (const auto& [use, key] : byAge) {
+    if (used_ <= bytes) break;
+    files << fileFor(key);
+    pending_.remove(key);
+    used_ -= index_.take(key).bytes;
+  }
+  removeFiles(files);                               // queued after any write of the same file
+  dirty_ = true;
+}
@@ -0,0 +1,80 @@
+// TtsCache.h
+
+/*
+  Persistent content-addressed cache of synthesized clauses (WAV files + LRU index)
+*/
+#pragma once
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QThreadPool>
+
+class QDataStream;
+struct WavFile;
+
+class TtsCache {
+public:
+  static constexpr qint64 kDefaultCapBytes = 256ll * 1024 * 1024;
+
+  explicit TtsCache(const QString& dir = defaultDir());
+  ~TtsCache();          // finishes queued writes
+
+  bool load();          // index only; files are opened on a hit
+  bool save();          // waits for queued writes, then the index; no-op unless something changed
+
+  // same text + language + reference voice + sampling params -> same key
+  static QByteArray key(const QString& text, const QString& lang,
+                        const QString& voice, const QString& params);
+
+  bool lookup(const QByteArray& key, WavFile* out);     // counts hits/misses
+  // same, but only the file's path (for a player that takes URLs)
+  bool lookupFile(const QByteArray& key, QString* path);
+  void store(const QByteArray& key, int sampleRate, int channels, const QByteArray& pcm);
+  void clear();
+
+  void   setCapBytes(qint64 bytes);
+  qint64 capBytes() const  { return cap_; }
+  qint64 usedBytes() const { return used_; }
+  int    entries() const   { return index_.size(); }
+  quint64 hits() const     { return hits_; }
+  quint64 misses() const   { return misses_; }
+  void   resetStats()      { hits_ = misses_ = 0; }
+
+  static QString defaultDir();
+
+private:
+  struct Entry {
+    qint64  bytes   = 0;
+    quint64 lastUse = 0;    // tick_ at the last hit/store
+  };
+  struct Pending {
+    quint64    seq = 0;     // queued_ when it was stored
+    QByteArray wav;         // header + samples, until written
+  };
+  static constexpr int kSaveEvery = 16;  // stores per background index write
+
+  QString                   dir_;
+  QHash<QByteArray, Entry>  index_;    // hex key -> entry; file is <dir>/<key>.wav
+  qint64                    cap_  = kDefaultCapBytes;
+  qint64                    used_ = 0;
+  quint64                   tick_ = 0;
+  quint64                   hits_ = 0, misses_ = 0;
+  bool                      dirty_ = false;
+  int                       unsaved_ = 0;   // stores since the index was last written
+
+  QHash<QByteArray, Pending> pending_;      // stored, file write still queued
+  quint64                   queued_ = 0;
+  QAtomicInteger<quint64>   written_ { 0 }; // last Pending::seq on disk (io_ thread)
+  QThreadPool               io_;            // one thread: writes, removals, index, in order
+
+  QString fileFor(const QByteArray& key) const;
+  void    evictTo(qint64 bytes);
+  void    removeFiles(const QStringList& files);
+  void    prunePending();
+  void    saveInBackground();
+  static bool writeIndex(const QString& dir, quint64 tick, const QHash<QByteArray, Entry>& index);
+
+  friend QDataStream& operator<<(QDataStream&, const Entry&);
+  friend QDataStream& operator>>(QDataStream&, Entry&);
+};
@@ -0,0 +1,105 @@
+/*
+
+WavFile
+
+Only what the TTS server writes (soundfile: PCM_16 by default, FLOAT when
+asked): fmt + data chunks, anything else is skipped. The mapping is dropped
+before returning; the PCM copy is a single memcpy for the common case.
+
+*/
+
+#include "WavFile.h"
+#include <QFile>
+#include <QtEndian>
+#include <cstring>
+
+static constexpr quint16 kFmtPcm        = 1;
+static constexpr quint16 kFmtFloat      = 3;
+static constexpr quint16 kFmtExtensible = 0xFFFE;
+
+static bool fail(QString* err, const QString& msg) {
+  if (err) *err = msg;
+  return false;
+}
+
+bool WavFile::read(const QString& path, QString* err) {
+  QFile f(path);
+  if (!f.open(QIODevice::ReadOnly)) return fail(err, f.errorString());
+  const qint64 size = f.size();
+  if (size < 44) return fail(err, QStringLiteral("too small"));
+  const uchar* base = f.map(0, size);
+  if (!base) return fail(err, f.errorString());
+  return parse(base, size, err);                      // QFile dtor unmaps
+}
+
+bool WavFile::parse(const QByteArray& bytes, QString* err) {
+  return parse(reinterpret_cast<const uchar*>(bytes.constData()), bytes.size(), err);
+}
+
+bool WavFile::parse(const uchar* base, qint64 size, QString* err) {
+  if (size < 44) return fail(err, QStringLiteral("too small"));
+  if (std::memcmp(base, "RIFF", 4) != 0 || std::memcmp(base + 8, "WAVE", 4) != 0)
+    return fail(err, QStringLiteral("not RIFF/WAVE"));
+
+  quint16 tag = 0, bits = 0;
+  const uchar* data = nullptr;
+  qint64 dataLen = 0;
+  for (qint64 off = 12; off + 8 <= size; ) {
+    const uchar* ck = base + off;
+    const qint64 len = qFromLittleEndian<quint32>(ck + 4);
+    const qint64 body = off + 8;
+    if (std::memcmp(ck, "fmt ", 4) == 0 && len >= 16 && body + 16 <= size) {
+      tag        = qFromLittleEndian<quint16>(ck + 8);
+      channels   = qFromLittleEndian<quint16>(ck + 10);
+      sampleRate = int(qFromLittleEndian<quint32>(ck + 12));
+      bits       = qFromLittleEndian<quint16>(ck + 22);
+      if (tag == kFmtExtensible && len >= 26 && body + 26 <= size)
+        tag = qFromLittleEndian<quint16>(ck + 32);   // SubFormat GUID's first 2 bytes
+    } else if (std::memcmp(ck, "data", 4) == 0) {
+      data    = base + body;
+      dataLen = qMin(len, size - body);               // tolerate a still-growing header
+      break;
+    }
+    off = body + len + (len & 1);                     // chunks are word aligned
+  }
+  if (!data || channels <= 0 || sampleRate <= 0) return fail(err, QStringLiteral("no fmt/data"));
+
+  if (tag == kFmtPcm && bits == 16) {
+    pcm = QByteArray(reinterpret_cast<const char*>(data), int(dataLen & ~qint64(1)));
+  } else if (tag == kFmtPcm && bits == 24) {
+    const qint64 n = dataLen / 3;
+    pcm.resize(int(n * 2));
+    auto* out = reinterpret_cast<qint16*>(pcm.data());
+    for (qint64 i = 0; i < n; ++i)                    // keep the top 16 bits
+      out[i] = qint16(data[i * 3 + 1] | (data[i * 3 + 2] << 8));
+  } else if (tag == kFmtFloat && bits == 32) {
+    const qint64 n = dataLen / 4;
+    pcm.resize(int(n * 2));
+    auto* out = reinterpret_cast<qint16*>(pcm.data());
+    for (qint64 i = 0; i < n; ++i) {
+      float v;
+      std::memcpy(&v, data + i * 4, 4);
+      out[i] = qint16(qBound(-1.0f, v, 1.0f) * 32767.0f);
+    }
+  } else {
+    return fail(err, QStringLiteral("unsupported WAV format %1/%2bit").arg(tag).arg(bits));
+  }
+  return true;
+}
+
+QByteArray WavFile::header(int sampleRate, int channels, quint32 dataBytes) {
+  // RIFF / fmt (PCM, 16 bit) / data
+  QByteArray wav(44, '\0');
+  uchar* h = reinterpret_cast<uchar*>(wav.data());
+  std::memcpy(h, "RIFF", 4);       qToLittleEndian<quint32>(36 + dataBytes, h + 4);
+  std::memcpy(h + 8, "WAVEfmt ", 8);
+  qToLittleEndian<quint32>(16, h + 16);
+  qToLittleEndian<quint16>(kFmtPcm, h + 20);
+  qToLittleEndian<quint16>(quint16(channels), h + 22);
+  qToLittleEndian<quint32>(quint32(sampleRate), h + 24);
+  qToLittleEndian<quint32>(quint32(sampleRate * channels * 2), h + 28);
+  qToLittleEndian<quint16>(quint16(channels * 2), h + 32);
+  qToLittleEndian<quint16>(16, h + 34);
+  std::memcpy(h + 36, "data", 4);  qToLittleEndian<quint32>(dataBytes, h + 40);
+  return wav;
+}
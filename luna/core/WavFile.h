@@ -0,0 +1,27 @@
+// WavFile.h
+
+/*
+  Minimal RIFF/WAVE reader over a memory-mapped file -> s16le PCM
+*/
+
+#pragma once
+#include <QByteArray>
+#include <QString>
+
+struct WavFile {
+  int        sampleRate = 0;
+  int        channels   = 0;
+  QByteArray pcm;          // interleaved s16le
+
+  // Maps the file, parses the chunks itself and copies the samples out once
+  // (16-bit PCM as is; 32-bit float / 24-bit PCM converted). No QMediaPlayer.
+  bool read(const QString& path, QString* err = nullptr);
+  // same, from a WAV already in memory (e.g. /speak's URL, downloaded)
+  bool parse(const QByteArray& bytes, QString* err = nullptr);
+
+  // canonical 44-byte RIFF header for `dataBytes` of 16-bit PCM
+  static QByteArray header(int sampleRate, int channels, quint32 dataBytes);
+
+private:
+  bool parse(const uchar* base, qint64 size, QString* err);
+};
@@ -0,0 +1,646 @@
+/*
+
+luna_mock — stand-in for the LLM (luna_llm/api.py) and TTS (gsv/api.py) servers
+
+  luna_mock [--host H] [--llm-port 8000] [--tts-port 9880] [--seed N]
+            [--llm-ttft D] [--llm-token D] [--token-chars N]
+            [--tts-latency D] [--tts-rtf F] [--chunk-ms D]
+            [--error-rate P] [--drop-rate P]
+            [--replies replies.jsonl] [--audio file] [--out-dir DIR] [--quiet]
+
+Same routes and JSON shapes as the real servers, no GPU, no Python:
+  GET  /health /config /set_ref
+  POST /chat /chat_stream        (NDJSON emotion / delta / done)
+  GET  /speak /speak_pcm /audio/<name>
+Both ports serve every route, so either URL can point anywhere.
+
+Latencies (D) are "ms" (fixed) or "uniform:lo,hi", "normal:mean,sd",
+"lognormal:median,sigma", all in ms; everything is drawn from one seeded
+generator so a run is repeatable. The reply for a message is picked by a hash
+of its text (same text -> same reply -> same audio, which is what the TTS
+cache wants). Audio is a short syllable-ish tone per character, or --audio:
+a WAV is used for /speak and /speak_pcm, anything else (test/v_lun0022.ogg)
+is served as is from /speak and the tone is streamed from /speak_pcm.
+
+--error-rate answers a /chat or /speak with a 500, --drop-rate cuts the
+connection partway through (mid-stream for the streaming routes).
+
+Minimal HTTP/1.1 over QTcpServer: keep-alive, Content-Length bodies,
+chunked responses. Enough for QNetworkAccessManager and curl.
+
+*/
+
+#include "../core/WavFile.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QHostAddress>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QRandomGenerator>
+#include <QRegularExpression>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTextStream>
+#include <QTimer>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QVector>
+#include <QtEndian>
+#include <QtMath>
+
+static QTextStream& out() { static QTextStream s(stdout); return s; }
+static QTextStream& err() { static QTextStream s(stderr); return s; }
+
+static constexpr int kPcmChunkSamples = 4096;     // same as gsv/api.py
+static constexpr int kToneRate        = 32000;    // GPT-SoVITS v2 output rate
+static constexpr int kMaxStoredAudio  = 64;       // /audio/* kept in memory
+static constexpr int kMaxHeaderBytes  = 64 * 1024;
+
+// ---- latency distributions ----
+
+struct Dist {
+  enum Kind { Fixed, Uniform, Normal, LogNormal };
+  Kind   kind = Fixed;
+  double a = 0, b = 0;
+
+  static bool parse(const QString& spec, Dist* d) {
+    const QString name = spec.section(':', 0, 0).trimmed().toLower();
+    const QStringList args = spec.section(':', 1).split(',', Qt::SkipEmptyParts);
+    bool ok1 = true, ok2 = true;
+    if (!spec.contains(':')) {
+      d->kind = Fixed;
+      d->a = spec.toDouble(&ok1);
+      return ok1 && d->a >= 0;
+    }
+    if (args.size() != 2) return false;
+    d->a = args[0].toDouble(&ok1);
+    d->b = args[1].toDouble(&ok2);
+    if (!ok1 || !ok2 || d->a < 0 || d->b < 0) return false;
+    if      (name == "uniform")   d->kind = Uniform;
+    else if (name == "normal")    d->kind = Normal;
+    else if (name == "lognormal") d->kind = LogNormal;
+    else return false;
+    return d->kind != Uniform || d->a <= d->b;
+  }
+
+  int sample(QRandomGenerator& rng) const {
+    double v = a;
+    switch (kind) {
+    case Fixed:     break;
+    case Uniform:   v = a + (b - a) * rng.generateDouble(); break;
+    case Normal:    v = a + b * gaussian(rng); break;
+    case LogNormal: v = a * qExp(b * gaussian(rng)); break;   // a = median
+    }
+    return qMax(0, qRound(v));
+  }
+
+  static double gaussian(QRandomGenerator& rng) {               // Box-Muller
+    const double u1 = qMax(1e-12, rng.generateDouble());
+    const double u2 = rng.generateDouble();
+    return qSqrt(-2.0 * qLn(u1)) * qCos(2.0 * M_PI * u2);
+  }
+};
+
+// ---- one HTTP connection ----
+
+struct Request {
+  QByteArray method;
+  QUrl       url;
+  QByteArray body;
+};
+
+class Mock;
+
+class Conn : public QObject {
+public:
+  struct Step { int delayMs; QByteArray data; };
+
+  Conn(QTcpSocket* s, Mock* m, bool quiet) : QObject(s), sock_(s), mock_(m), quiet_(quiet) {
+    connect(s, &QTcpSocket::readyRead, this, [this]{
+      buf_ += sock_->readAll();
+      if (!busy_) parse();
+    });
+    connect(s, &QTcpSocket::disconnected, s, &QObject::deleteLater);   // takes us along
+  }
+
+  bool alive() const { return sock_->state() == QAbstractSocket::ConnectedState; }
+
+  void send(int status, const QByteArray& type, const QByteArray& body,
+            const QList<QPair<QByteArray, QByteArray>>& extra = {}) {
+    if (!alive()) return;
+    QByteArray head = statusLine(status) + "Content-Type: " + type + "\r\n"
+                    + "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    for (const auto& h : extra) head += h.first + ": " + h.second + "\r\n";
+    sock_->write(head + connectionHeader() + "\r\n");
+    sock_->write(body);
+    done(status);
+  }
+
+  void sendJson(int status, const QJsonObject& o) {
+    send(status, "application/json", QJsonDocument(o).toJson(QJsonDocument::Compact));
+  }
+
+  // chunked response: headers now, then `steps` one after another (each
+  // after its own delay); cut the connection before step `dropAt` (-1: never)
+  void stream(const QByteArray& type, const QList<QPair<QByteArray, QByteArray>>& extra,
+              const QVector<Step>& steps, int dropAt) {
+    if (!alive()) return;
+    QByteArray head = statusLine(200) + "Content-Type: " + type + "\r\n"
+                    + "Transfer-Encoding: chunked\r\n";
+    for (const auto& h : extra) head += h.first + ": " + h.second + "\r\n";
+    sock_->write(head + connectionHeader() + "\r\n");
+    steps_  = steps;
+    dropAt_ = dropAt;
+    nextStep(0);
+  }
+
+  // no response at all, mid-body or before headers
+  void drop() {
+    if (!quiet_) err() << what_ << " -> dropped after " << t_.elapsed() << " ms" << Qt::endl;
+    sock_->abort();
+  }
+
+private:
+  QTcpSocket* sock_;
+  Mock*       mock_;
+  bool        quiet_;
+  QByteArray  buf_;
+  bool        busy_ = false;        // one request at a time; the rest waits in buf_
+  bool        keepAlive_ = true;
+  QByteArray  what_;
+  QElapsedTimer t_;
+  QVector<Step> steps_;
+  int         dropAt_ = -1;
+
+  void parse();
+  void done(int status);
+
+  void nextStep(int i) {
+    if (!alive()) return;
+    if (i == dropAt_) { drop(); return; }
+    if (i >= steps_.size()) {
+      sock_->write("0\r\n\r\n");
+      steps_.clear();
+      done(200);
+      return;
+    }
+    QTimer::singleShot(steps_[i].delayMs, this, [this, i]{
+      if (!alive()) return;
+      const QByteArray& d = steps_[i].data;
+      if (!d.isEmpty()) sock_->write(QByteArray::number(d.size(), 16) + "\r\n" + d + "\r\n");
+      nextStep(i + 1);
+    });
+  }
+
+  static QByteArray statusLine(int status) {
+    const char* text = "OK";
+    switch (status) {
+    case 400: text = "Bad Request"; break;
+    case 404: text = "Not Found"; break;
+    case 405: text = "Method Not Allowed"; break;
+    case 422: text = "Unprocessable Entity"; break;
+    case 500: text = "Internal Server Error"; break;
+    }
+    return "HTTP/1.1 " + QByteArray::number(status) + ' ' + text + "\r\n";
+  }
+
+  QByteArray connectionHeader() const {
+    return keepAlive_ ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+  }
+};
+
+// ---- the two fake backends ----
+
+class Mock {
+public:
+  struct Options {
+    Dist    llmTtft  { Dist::Fixed, 150, 0 };
+    Dist    llmToken { Dist::Fixed, 25, 0 };
+    int     tokenChars = 2;        // characters per streamed "token"
+    Dist    ttsLatency { Dist::Fixed, 300, 0 };
+    double  ttsRtf = 0;            // extra latency per second of audio
+    Dist    chunkMs { Dist::Fixed, 20, 0 };
+    double  errorRate = 0;
+    double  dropRate = 0;
+    QString outDir;
+    bool    quiet = false;
+  };
+
+  struct Reply { QString emotion, sentence; };
+
+  Mock(const Options& o, quint32 seed) : opt_(o), rng_(seed) {
+    defaults_ = QJsonObject{
+      { "ref_wav",   QStringLiteral("mock/ref.wav") },
+      { "ref_text",  QStringLiteral("mock") },
+      { "ref_lang",  QStringLiteral("ja") },
+      { "text_lang", QStringLiteral("ja") },
+      { "basename",  QStringLiteral("utt") },
+    };
+    replies_ = {
+      { "<E:smile>",    QStringLiteral("「おかえりなさい。今日はどうだった？」") },
+      { "<E:serious>",  QStringLiteral("「それは大変だったね、少し休もうか。」") },
+      { "<E:blush>",    QStringLiteral("「えっ、そんなこと急に言われても……！」") },
+      { "<E:thinking>", QStringLiteral("「うーん、どうしようかな。もう少し考えさせて。」") },
+      { "<E:smirk>",    QStringLiteral("「ふふ、やっぱりそう来ると思った。」") },
+    };
+  }
+
+  bool loadReplies(const QString& path) {
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) return false;
+    QVector<Reply> rs;
+    while (!f.atEnd()) {
+      const QJsonObject o = QJsonDocument::fromJson(f.readLine().trimmed()).object();
+      const QString s = o.value(QStringLiteral("sentence")).toString();
+      if (!s.isEmpty()) rs.push_back({ o.value(QStringLiteral("emotion")).toString(), s });
+    }
+    if (rs.isEmpty()) return false;
+    replies_ = rs;
+    return true;
+  }
+
+  // WAV: decoded once and used for every clip; anything else is served raw
+  bool loadAudio(const QString& path) {
+    WavFile wav;
+    if (wav.read(path)) { canned_ = wav; return true; }
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) return false;
+    cannedRaw_    = f.readAll();
+    cannedSuffix_ = QFileInfo(path).suffix().toLower();
+    return !cannedRaw_.isEmpty();
+  }
+
+  bool listen(QTcpServer* server, const QHostAddress& host, quint16 port) {
+    QObject::connect(server, &QTcpServer::newConnection, server, [this, server]{
+      while (QTcpSocket* s = server->nextPendingConnection()) new Conn(s, this, opt_.quiet);
+    });
+    return server->listen(host, port);
+  }
+
+  void handle(Conn* c, const Request& r) {
+    const QString path = r.url.path();
+    const QUrlQuery q(r.url);
+    const bool get = r.method == "GET", post = r.method == "POST";
+
+    if (path == "/health") {
+      if (!get) return notAllowed(c);
+      return c->sendJson(200, { { "ok", true } });
+    }
+    if (path == "/config") {
+      if (!get) return notAllowed(c);
+      return c->sendJson(200, { { "device", "mock" },
+                                { "out_dir", QDir(opt_.outDir).absolutePath() },
+                                { "defaults", defaults_ }, { "voice", voiceId() } });
+    }
+    if (path == "/set_ref") {
+      if (!get) return notAllowed(c);
+      for (const char* k : { "ref_wav", "ref_text", "ref_lang", "text_lang", "basename" })
+        if (q.hasQueryItem(k)) defaults_[QString::fromLatin1(k)] = q.queryItemValue(k, QUrl::FullyDecoded);
+      return c->sendJson(200, { { "ok", true }, { "defaults", defaults_ }, { "voice", voiceId() } });
+    }
+    if (path.startsWith("/audio/")) {
+      if (!get) return notAllowed(c);
+      const QString name = path.mid(7);
+      if (!audio_.contains(name)) return c->sendJson(404, { { "detail", "Not Found" } });
+      return c->send(200, mimeFor(name), audio_.value(name));
+    }
+    if (path == "/chat" || path == "/chat_stream") {
+      if (!post) return notAllowed(c);
+      const QJsonObject o = QJsonDocument::fromJson(r.body).object();
+      if (!o.value("user").isString()) return missing(c, "user");
+      if (injectFailure(c)) return;
+      return chat(c, o.value("user").toString(), path == "/chat_stream",
+                  o.value("early_emotion").toBool());
+    }
+    if (path == "/speak" || path == "/speak_pcm") {
+      if (!get) return notAllowed(c);
+      const QString text = q.queryItemValue("text", QUrl::FullyDecoded);
+      if (text.isEmpty()) return missing(c, "text");
+      if (injectFailure(c)) return;
+      const QString lang = q.hasQueryItem("text_lang") ? q.queryItemValue("text_lang", QUrl::FullyDecoded)
+                                                       : defaults_.value("text_lang").toString();
+      return path == "/speak" ? speak(c, text, lang, q.queryItemValue("basename", QUrl::FullyDecoded))
+                              : speakPcm(c, text);
+    }
+    c->sendJson(404, { { "detail", "Not Found" } });
+  }
+
+private:
+  // like the real server's: changes with /set_ref
+  QString voiceId() const {
+    const QString raw = defaults_.value("ref_wav").toString() + '\n' + defaults_.value("ref_text").toString()
+                      + '\n' + defaults_.value("ref_lang").toString();
+    return QString::fromLatin1(QCryptographicHash::hash(raw.toUtf8(), QCryptographicHash::Sha1).toHex().left(16));
+  }
+
+  Options          opt_;
+  QRandomGenerator rng_;
+  QJsonObject      defaults_;
+  QVector<Reply>   replies_;
+  WavFile          canned_;          // sampleRate == 0: none
+  QByteArray       cannedRaw_;
+  QString          cannedSuffix_;
+  QHash<QString, QByteArray> audio_;
+  QStringList      audioOrder_;      // oldest first, capped at kMaxStoredAudio
+  int              clipSeq_ = 0;
+
+  bool roll(double p) { return p > 0 && rng_.generateDouble() < p; }
+
+  void notAllowed(Conn* c) { c->sendJson(405, { { "detail", "Method Not Allowed" } }); }
+  void missing(Conn* c, const char* field) {
+    c->sendJson(422, { { "detail", QStringLiteral("missing field: %1").arg(field) } });
+  }
+
+  bool injectFailure(Conn* c) {
+    if (roll(opt_.errorRate)) { c->sendJson(500, { { "detail", "injected failure" } }); return true; }
+    return false;
+  }
+
+  const Reply& pick(const QString& user) const {
+    const QByteArray h = QCryptographicHash::hash(user.toUtf8(), QCryptographicHash::Md5);
+    return replies_.at(int(qFromLittleEndian<quint32>(h.constData()) % quint32(replies_.size())));
+  }
+
+  // ---- LLM ----
+
+  void chat(Conn* c, const QString& user, bool streaming, bool earlyEmotion) {
+    const Reply& rep = pick(user);
+    const int n = qMax(1, opt_.tokenChars);
+    const int emoTokens = qMax(1, int((rep.emotion.size() + n - 1) / n));
+
+    if (!streaming && earlyEmotion) {
+      // like the real /chat with early_emotion: headers (X-Emotion) once line 1
+      // is done, the JSON body when the sentence is
+      int head = opt_.llmTtft.sample(rng_), rest = 0;
+      for (int i = 1; i < emoTokens; ++i) head += opt_.llmToken.sample(rng_);
+      for (int i = 0; i < rep.sentence.size(); i += n) rest += opt_.llmToken.sample(rng_);
+      const QByteArray body = QJsonDocument(QJsonObject{ { "emotion", rep.emotion },
+                                                         { "sentence", rep.sentence } })
+                                .toJson(QJsonDocument::Compact);
+      const QList<QPair<QByteArray, QByteArray>> headers{
+        { "X-Emotion", QUrl::toPercentEncoding(rep.emotion) } };
+      const int dropAt = roll(opt_.dropRate) ? 0 : -1;
+      QPointer<Conn> pc(c);
+      QTimer::singleShot(head, c, [pc, headers, body, rest, dropAt]{
+        if (pc) pc->stream("application/json", headers, { { rest, body } }, dropAt);
+      });
+      return;
+    }
+
+    if (!streaming) {
+      int total = opt_.llmTtft.sample(rng_);
+      for (int i = 1; i < emoTokens + (rep.sentence.size() + n - 1) / n; ++i)
+        total += opt_.llmToken.sample(rng_);
+      const bool drop = roll(opt_.dropRate);
+      const QJsonObject body{ { "emotion", rep.emotion }, { "sentence", rep.sentence } };
+      QPointer<Conn> pc(c);
+      QTimer::singleShot(drop ? total / 2 : total, c, [pc, drop, body]{
+        if (!pc) return;
+        if (drop) pc->drop(); else pc->sendJson(200, body);
+      });
+      return;
+    }
+
+    // the emotion event goes out once its whole line has been "generated"
+    auto line = [](const QJsonObject& o) { return QJsonDocument(o).toJson(QJsonDocument::Compact) + '\n'; };
+    QVector<Conn::Step> steps;
+    int wait = opt_.llmTtft.sample(rng_);
+    for (int i = 1; i < emoTokens; ++i) wait += opt_.llmToken.sample(rng_);
+    steps.push_back({ wait, line({ { "type", "emotion" }, { "emotion", rep.emotion } }) });
+    for (int i = 0; i < rep.sentence.size(); i += n)
+      steps.push_back({ opt_.llmToken.sample(rng_),
+                        line({ { "type", "delta" }, { "text", rep.sentence.mid(i, n) } }) });
+    steps.push_back({ 0, line({ { "type", "done" }, { "emotion", rep.emotion },
+                                { "sentence", rep.sentence } }) });
+    const int dropAt = roll(opt_.dropRate) ? 1 + int(rng_.bounded(steps.size() - 1)) : -1;
+    c->stream("application/x-ndjson", {}, steps, dropAt);
+  }
+
+  // ---- TTS ----
+
+  // ~0.12 s per character, one soft blip each, pitch from the character
+  static QByteArray tone(const QString& text) {
+    QString chars = text;
+    chars.remove(QRegularExpression(QStringLiteral("[\\s「」]")));
+    const double secs = qBound(0.3, 0.12 * chars.size(), 8.0);
+    const int total = int(secs * kToneRate);
+    const int per = qMax(1, total / qMax(1, int(chars.size())));
+    QByteArray pcm(total * 2, '\0');
+    qint16* s = reinterpret_cast<qint16*>(pcm.data());
+    for (int i = 0; i < total; ++i) {
+      const int syl = qMin(i / per, int(chars.size()) - 1);
+      const double f = 180.0 + 20.0 * (syl >= 0 ? chars.at(syl).unicode() % 7 : 0);
+      const double env = qSin(M_PI * double(i % per) / per);
+      s[i] = qint16(0.25 * 32767.0 * env * qSin(2.0 * M_PI * f * i / kToneRate));
+    }
+    return pcm;
+  }
+
+  // pcm + rate for `text`: the canned WAV or the tone
+  QByteArray clipPcm(const QString& text, int* rate, int* channels) const {
+    if (canned_.sampleRate > 0) { *rate = canned_.sampleRate; *channels = canned_.channels; return canned_.pcm; }
+    *rate = kToneRate; *channels = 1;
+    return tone(text);
+  }
+
+  int ttsDelay(int pcmBytes, int rate, int channels) {
+    const double secs = double(pcmBytes) / (2.0 * rate * channels);
+    return opt_.ttsLatency.sample(rng_) + qRound(opt_.ttsRtf * secs * 1000.0);
+  }
+
+  void storeAudio(const QString& name, const QByteArray& bytes) {
+    audio_.insert(name, bytes);
+    audioOrder_ << name;
+    while (audioOrder_.size() > kMaxStoredAudio) audio_.remove(audioOrder_.takeFirst());
+  }
+
+  static QByteArray mimeFor(const QString& name) {
+    if (name.endsWith(".wav")) return "audio/wav";
+    if (name.endsWith(".ogg")) return "audio/ogg";
+    if (name.endsWith(".mp3")) return "audio/mpeg";
+    return "application/octet-stream";
+  }
+
+  void speak(Conn* c, const QString& text, const QString& lang, QString stem) {
+    if (stem.isEmpty()) stem = defaults_.value("basename").toString();
+    int rate = 0, ch = 0;
+    QByteArray bytes;
+    QString suffix = "wav";
+    if (!cannedRaw_.isEmpty()) {
+      bytes  = cannedRaw_;
+      suffix = cannedSuffix_;
+      rate   = kToneRate;                        // unknown; the client only uses it as a hint
+    } else {
+      const QByteArray pcm = clipPcm(text, &rate, &ch);
+      bytes = WavFile::header(rate, ch, quint32(pcm.size())) + pcm;
+    }
+    const int delay = ttsDelay(cannedRaw_.isEmpty() ? bytes.size() - 44 : 0, rate, qMax(1, ch));
+    const QString name = QStringLiteral("%1_%2.%3").arg(stem).arg(++clipSeq_).arg(suffix);
+
+    QJsonObject body{ { "ok", true }, { "sample_rate", rate },
+                      { "url", "/audio/" + name }, { "text_lang", lang },
+                      { "voice", voiceId() } };
+    storeAudio(name, bytes);
+    if (!opt_.outDir.isEmpty()) {
+      // same as the real server: a file the client may read directly
+      const QString p = QDir(opt_.outDir).absoluteFilePath(name);
+      QFile f(p);
+      if (f.open(QIODevice::WriteOnly) && f.write(bytes) == bytes.size()) body["path"] = p;
+    }
+
+    const bool drop = roll(opt_.dropRate);
+    QPointer<Conn> pc(c);
+    QTimer::singleShot(drop ? delay / 2 : delay, c, [pc, drop, body]{
+      if (!pc) return;
+      if (drop) pc->drop(); else pc->sendJson(200, body);
+    });
+  }
+
+  void speakPcm(Conn* c, const QString& text) {
+    int rate = 0, ch = 0;
+    const QByteArray pcm = clipPcm(text, &rate, &ch);
+    const int chunkBytes = kPcmChunkSamples * 2 * ch;
+
+    // headers only after "synthesis", like the real one; then chunk by chunk
+    QVector<Conn::Step> steps;
+    for (int off = 0; off < pcm.size(); off += chunkBytes)
+      steps.push_back({ off ? opt_.chunkMs.sample(rng_) : 0, pcm.mid(off, chunkBytes) });
+    const int dropAt = (roll(opt_.dropRate) && steps.size() > 1) ? 1 + int(rng_.bounded(steps.size() - 1)) : -1;
+    const QList<QPair<QByteArray, QByteArray>> headers{
+      { "X-Sample-Rate", QByteArray::number(rate) },
+      { "X-Channels", QByteArray::number(ch) },
+      { "X-Sample-Format", "s16le" },
+      { "X-Voice", voiceId().toLatin1() },
+    };
+
+    QPointer<Conn> pc(c);
+    QTimer::singleShot(ttsDelay(pcm.size(), rate, ch), c, [pc, headers, steps, dropAt]{
+      if (pc) pc->stream("application/octet-stream", headers, steps, dropAt);
+    });
+  }
+};
+
+// ---- Conn, the parts that need Mock ----
+
+void Conn::parse() {
+  const int end = buf_.indexOf("\r\n\r\n");
+  if (end < 0) {
+    if (buf_.size() > kMaxHeaderBytes) sock_->abort();
+    return;
+  }
+  const QList<QByteArray> lines = buf_.left(end).split('\n');
+  const QList<QByteArray> first = lines.value(0).trimmed().split(' ');
+  if (first.size() != 3) { sock_->abort(); return; }
+
+  qint64 length = 0;
+  QByteArray connection;
+  for (int i = 1; i < lines.size(); ++i) {
+    const int colon = lines[i].indexOf(':');
+    if (colon < 0) continue;
+    const QByteArray key = lines[i].left(colon).trimmed().toLower();
+    const QByteArray val = lines[i].mid(colon + 1).trimmed();
+    if (key == "content-length") length = val.toLongLong();
+    else if (key == "connection") connection = val.toLower();
+  }
+  if (buf_.size() < end + 4 + length) return;      // body still coming
+
+  Request r;
+  r.method = first[0];
+  r.url    = QUrl(QString::fromLatin1(first[1]));
+  r.body   = buf_.mid(end + 4, int(length));
+  buf_.remove(0, end + 4 + int(length));
+  keepAlive_ = first[2] == "HTTP/1.1" ? connection != "close" : connection == "keep-alive";
+
+  busy_ = true;
+  what_ = r.method + ' ' + r.url.path().toUtf8();
+  t_.start();
+  mock_->handle(this, r);
+}
+
+void Conn::done(int status) {
+  if (!quiet_) err() << what_ << " -> " << status << " in " << t_.elapsed() << " ms" << Qt::endl;
+  busy_ = false;
+  if (!keepAlive_) { sock_->disconnectFromHost(); return; }
+  if (!buf_.isEmpty()) QTimer::singleShot(0, this, [this]{ if (!busy_) parse(); });
+}
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("luna-mock");
+
+  QCommandLineParser p;
+  p.setApplicationDescription("Mock LLM/TTS backends with configurable latency and failures.");
+  p.addHelpOption();
+  p.addOption({ "host", "Address to listen on (default 127.0.0.1).", "addr", "127.0.0.1" });
+  p.addOption({ "llm-port", "LLM port (default 8000).", "port", "8000" });
+  p.addOption({ "tts-port", "TTS port (default 9880).", "port", "9880" });
+  p.addOption({ "seed", "Random seed (default 1).", "n", "1" });
+  p.addOption({ "llm-ttft", "Time to first token (default 150).", "dist", "150" });
+  p.addOption({ "llm-token", "Time between tokens (default 25).", "dist", "25" });
+  p.addOption({ "token-chars", "Characters per token (default 2).", "n", "2" });
+  p.addOption({ "tts-latency", "Synthesis time before the reply (default 300).", "dist", "300" });
+  p.addOption({ "tts-rtf", "Extra synthesis time per second of audio (default 0).", "f", "0" });
+  p.addOption({ "chunk-ms", "Gap between /speak_pcm chunks (default 20).", "dist", "20" });
+  p.addOption({ "error-rate", "Fraction of /chat and /speak answered with 500.", "p", "0" });
+  p.addOption({ "drop-rate", "Fraction of /chat and /speak cut off partway.", "p", "0" });
+  p.addOption({ "replies", "JSONL of {\"emotion\",\"sentence\"} replies.", "file" });
+  p.addOption({ "audio", "Canned clip (WAV, or e.g. test/v_lun0022.ogg for /speak).", "file" });
+  p.addOption({ "out-dir", "Also write /speak clips here and report their path.", "dir" });
+  p.addOption({ "quiet", "No per-request log." });
+  p.process(app);
+
+  Mock::Options o;
+  for (auto [name, dist] : { std::pair{ "llm-ttft", &o.llmTtft }, std::pair{ "llm-token", &o.llmToken },
+                             std::pair{ "tts-latency", &o.ttsLatency }, std::pair{ "chunk-ms", &o.chunkMs } }) {
+    if (!Dist::parse(p.value(name), dist)) {
+      err() << "bad --" << name << ": " << p.value(name)
+            << " (ms, uniform:lo,hi, normal:mean,sd or lognormal:median,sigma)" << Qt::endl;
+      return 2;
+    }
+  }
+  o.tokenChars = qMax(1, p.value("token-chars").toInt());
+  o.ttsRtf     = qMax(0.0, p.value("tts-rtf").toDouble());
+  o.errorRate  = qBound(0.0, p.value("error-rate").toDouble(), 1.0);
+  o.dropRate   = qBound(0.0, p.value("drop-rate").toDouble(), 1.0);
+  o.outDir     = p.value("out-dir");
+  o.quiet      = p.isSet("quiet");
+  if (!o.outDir.isEmpty() && !QDir().mkpath(o.outDir)) {
+    err() << "cannot create " << o.outDir << Qt::endl;
+    return 2;
+  }
+
+  Mock mock(o, p.value("seed").toUInt());
+  if (p.isSet("replies") && !mock.loadReplies(p.value("replies"))) {
+    err() << "no replies in " << p.value("replies") << Qt::endl;
+    return 2;
+  }
+  if (p.isSet("audio") && !mock.loadAudio(p.value("audio"))) {
+    err() << "cannot read " << p.value("audio") << Qt::endl;
+    return 2;
+  }
+
+  const QHostAddress host(p.value("host"));
+  QTcpServer llm, tts;
+  const quint16 llmPort = quint16(p.value("llm-port").toUInt());
+  const quint16 ttsPort = quint16(p.value("tts-port").toUInt());
+  if (!mock.listen(&llm, host, llmPort)) {
+    err() << "llm: " << llm.errorString() << Qt::endl;
+    return 1;
+  }
+  if (ttsPort != llmPort && !mock.listen(&tts, host, ttsPort)) {
+    err() << "tts: " << tts.errorString() << Qt::endl;
+    return 1;
+  }
+  out() << "llm on http://" << host.toString() << ':' << llm.serverPort()
+        << ", tts on http://" << host.toString() << ':' << (tts.isListening() ? tts.serverPort() : llm.serverPort())
+        << Qt::endl;
+  return app.exec();
+}
@@ -0,0 +1,126 @@
+/*
+
+luna_pack — offline sprite pack compiler
+
+  luna_pack [--lz4] [--no-patches] <modes-root | mode-dir>...
+
+For every mode folder (a directory with PNGs) writes <mode>/<mode>.lunapack
+holding the frame index, the mode's sum.json and every frame as
+premultiplied ARGB32 (optionally LZ4). ModeManager picks the pack up
+automatically and stops scanning/decoding the PNGs of that mode.
+
+Frames are grouped by pose (lun_s_M_P_NN -> lun_s_M_P); the first frame of
+each pose is stored whole and the others only as the face region that
+differs from it.
+
+*/
+
+#include "../core/SpritePack.h"
+#include "../core/FrameIndex.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QImageReader>
+#include <QRegularExpression>
+#include <QTextStream>
+
+static QTextStream& out() { static QTextStream s(stdout); return s; }
+static QTextStream& err() { static QTextStream s(stderr); return s; }
+
+// "lun_s_5_0_07" -> "lun_s_5_0"; names without a trailing _NN are their own pose
+static QString poseKey(const QString& basename) {
+  static const QRegularExpression re(QStringLiteral("^(.*)_\\d+$"));
+  const auto m = re.match(basename);
+  return m.hasMatch() ? m.captured(1) : basename;
+}
+
+static bool packMode(const QString& modeDir, bool lz4, bool patches) {
+  QDir d(modeDir);
+  const QStringList pngs = d.entryList({ "*.png", "*.PNG" }, QDir::Files, QDir::Name);
+  if (pngs.isEmpty()) return true;   // not a mode folder
+
+  QElapsedTimer t; t.start();
+  QVector<SpritePack::Frame> frames;
+  frames.reserve(pngs.size());
+  qint64 pngBytes = 0;
+  for (const auto& p : pngs) {
+    const QString path = d.absoluteFilePath(p);
+    QImageReader reader(path);
+    QImage img = reader.read();
+    if (img.isNull()) {
+      err() << "  skip " << p << ": " << reader.errorString() << Qt::endl;
+      continue;
+    }
+    img.convertTo(QImage::Format_ARGB32_Premultiplied);
+    pngBytes += QFileInfo(path).size();
+    frames.push_back({ QFileInfo(p).completeBaseName(), img, FrameIndex::opaqueBounds(img) });
+  }
+
+  if (patches) {
+    QHash<QString, int> bases;       // pose -> first frame index (sorted by name)
+    for (int i = 0; i < frames.size(); ++i) {
+      const QString pose = poseKey(frames[i].name);
+      const auto it = bases.constFind(pose);
+      if (it == bases.constEnd()) bases.insert(pose, i);
+      else                        frames[i].base = *it;
+    }
+  }
+
+  QByteArray emotions;
+  QFile sum(d.absoluteFilePath(QStringLiteral("sum.json")));
+  if (sum.open(QIODevice::ReadOnly)) emotions = sum.readAll();
+
+  const QString target = SpritePack::fileNameFor(d.absolutePath());
+  QString why;
+  if (!SpritePack::write(target, frames, emotions, lz4, &why)) {
+    err() << "error: " << target << ": " << why << Qt::endl;
+    return false;
+  }
+  out() << d.dirName() << ": " << frames.size() << " frames, "
+        << (pngBytes >> 10) << " KB png -> " << (QFileInfo(target).size() >> 10) << " KB pack ("
+        << t.elapsed() << " ms)" << Qt::endl;
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("luna_pack");
+
+  QCommandLineParser cli;
+  cli.setApplicationDescription("Compile ui/assets/modes/<mode>/ PNGs into <mode>.lunapack files.");
+  cli.addHelpOption();
+  QCommandLineOption lz4Opt("lz4", "LZ4-compress frame payloads (smaller file, no zero-copy).");
+  cli.addOption(lz4Opt);
+  QCommandLineOption noPatchOpt("no-patches", "Store every frame whole instead of base + face patch.");
+  cli.addOption(noPatchOpt);
+  cli.addPositionalArgument("paths", "Modes root(s) or individual mode folder(s).", "<path>...");
+  cli.process(app);
+
+  const bool lz4     = cli.isSet(lz4Opt);
+  const bool patches = !cli.isSet(noPatchOpt);
+  if (lz4 && !SpritePack::lz4Available()) {
+    err() << "error: luna_pack was built without LZ4" << Qt::endl;
+    return 2;
+  }
+  const QStringList paths = cli.positionalArguments();
+  if (paths.isEmpty()) cli.showHelp(1);
+
+  bool ok = true;
+  for (const auto& p : paths) {
+    QDir root(p);
+    if (!root.exists()) { err() << "error: no such dir " << p << Qt::endl; ok = false; continue; }
+    // a mode folder itself, or a root of mode folders
+    if (!root.entryList({ "*.png", "*.PNG" }, QDir::Files).isEmpty()) {
+      ok &= packMode(root.absolutePath(), lz4, patches);
+      continue;
+    }
+    for (const auto& sub : root.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name))
+      ok &= packMode(root.absoluteFilePath(sub), lz4, patches);
+  }
+  return ok ? 0 : 1;
+}
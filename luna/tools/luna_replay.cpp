@@ -0,0 +1,293 @@
+/*
+
+luna_replay — headless load replay for the LLM/TTS backends
+
+  luna_replay [--llm URL] [--tts URL] [--concurrency N | --rate R]
+              [--count N] [--timeout S] [--no-stream] [--tts-cache] [--sessions]
+              [--json report.json] <workload.jsonl>
+
+Each JSONL line is one user message: the first of "user", "text", "body",
+"title" that is a non-empty string (so the repo's requests.jsonl works as
+is). Lines are sent in order, wrapping around until --count is reached.
+
+  --concurrency N   closed loop: N clients, each sends its next line as soon
+                    as the previous reply is complete (default, N=1)
+  --rate R          open loop: a new request every 1/R s regardless of how
+                    many are still running
+
+Requests are stateless by default. --sessions gives every client one LLM
+session, so its lines become one growing conversation (server-side KV reuse).
+
+Every request goes through a real BackendClient (same streaming, clause
+TTS, PCM and cache paths as the app, no widgets, nothing played). Per
+stage it reports n / p50 / p95 / p99 / max in ms since submit, plus
+throughput. Exit code 1 if no request completed. A reply whose text came
+back but none of whose clauses produced audio counts as "no-audio", not ok.
+
+All clients share one TtsCache (with --tts-cache), so hit rates depend on
+the workload rather than on which client saved its index last.
+
+*/
+
+#include "../core/BackendClient.h"
+#include "../core/BackendSupervisor.h"
+#include "../core/LatencyTrace.h"
+#include "../core/TtsCache.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QSettings>
+#include <QTextStream>
+#include <QTimer>
+#include <QVector>
+
+static QTextStream& out() { static QTextStream s(stdout); return s; }
+static QTextStream& err() { static QTextStream s(stderr); return s; }
+
+using Stage  = LatencyTrace::Stage;
+using Record = LatencyTrace::Record;
+
+static QStringList readWorkload(const QString& path) {
+  QStringList lines;
+  QFile f(path);
+  if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) return lines;
+  while (!f.atEnd()) {
+    const QByteArray raw = f.readLine().trimmed();
+    if (raw.isEmpty()) continue;
+    const QJsonObject o = QJsonDocument::fromJson(raw).object();
+    for (const char* k : { "user", "text", "body", "title" }) {
+      const QString v = o.value(QLatin1String(k)).toString().trimmed();
+      if (!v.isEmpty()) { lines << v; break; }
+    }
+  }
+  return lines;
+}
+
+class Replay : public QObject {
+public:
+  struct Options {
+    QUrl    llm { QStringLiteral("http://127.0.0.1:8000") };
+    QUrl    tts { QStringLiteral("http://127.0.0.1:9880") };
+    int     concurrency = 1;
+    double  rate = 0;           // > 0: open loop
+    int     count = 0;
+    int     timeoutMs = 120000;
+    bool    streaming = true;
+    bool    ttsCache = false;
+    bool    sessions = false;
+    QString jsonPath;
+  };
+
+  Replay(const Options& o, const QStringList& work) : opt_(o), work_(work) {
+    if (opt_.ttsCache) {
+      const qint64 mb = QSettings().value("ttsCacheMB",
+                                          TtsCache::kDefaultCapBytes / (1024 * 1024)).toLongLong();
+      cache_.setCapBytes(mb * 1024 * 1024);
+      cache_.load();
+    } else {
+      cache_.setCapBytes(0);                       // every clause goes to the server
+      cache_.clear();
+    }
+  }
+  ~Replay() override {
+    for (Slot* s : slots_) delete s->client;       // they use cache_: go before it does
+    qDeleteAll(slots_);
+  }
+
+  void start() {
+    wall_.start();
+    if (opt_.rate > 0) {
+      auto* t = new QTimer(this);
+      t->setInterval(qMax(1, int(1000.0 / opt_.rate)));
+      connect(t, &QTimer::timeout, this, [this, t]{
+        if (sent_ >= opt_.count) { t->stop(); return; }
+        send(idleClient());
+      });
+      t->start();
+      send(idleClient());
+    } else {
+      for (int i = 0; i < opt_.concurrency && sent_ < opt_.count; ++i) send(idleClient());
+    }
+  }
+
+private:
+  struct Slot {
+    BackendClient* client = nullptr;
+    QTimer*        timeout = nullptr;
+    QElapsedTimer  t;
+    Record         rec;
+    bool           busy = false;
+  };
+
+  Options          opt_;
+  QStringList      work_;
+  TtsCache         cache_;                         // shared by every slot's client
+  QVector<Slot*>   slots_;
+  QVector<Record>  done_;
+  QElapsedTimer    wall_;
+  int              sent_ = 0, finished_ = 0, errors_ = 0, noAudio_ = 0, timeouts_ = 0;
+
+  Slot* idleClient() {
+    for (Slot* s : slots_) if (!s->busy) return s;
+    auto* s = new Slot;
+    s->client = new BackendClient(this);
+    s->client->setLatencyTrace(false);             // many clients: per-slot records instead
+    s->client->supervisor()->setWarmupPath({});    // don't add warm-ups to the workload
+    s->client->setStreaming(opt_.streaming);
+    s->client->setLlmBaseUrl(opt_.llm);
+    s->client->setTtsBaseUrl(opt_.tts);
+    if (!opt_.sessions) s->client->setSession({});
+    s->client->setTtsCache(&cache_);
+
+    s->timeout = new QTimer(this);
+    s->timeout->setSingleShot(true);
+    connect(s->timeout, &QTimer::timeout, this, [this, s]{
+      ++timeouts_;
+      s->client->cancel();
+      complete(s, false);
+    });
+
+    auto stamp = [s](int stage) {
+      if (s->busy && stage >= 0 && stage < LatencyTrace::StageCount && s->rec.us[stage] < 0)
+        s->rec.us[stage] = s->t.nsecsElapsed() / 1000;
+    };
+    connect(s->client, &BackendClient::stageReached, this, [stamp](int, int stage){ stamp(stage); });
+    connect(s->client, &BackendClient::clauseAudio, this, [stamp](const QUrl&){ stamp(LatencyTrace::AudioSourceSet); });
+    connect(s->client, &BackendClient::pcmData, this, [stamp](const QByteArray&){ stamp(LatencyTrace::AudioSourceSet); });
+    connect(s->client, &BackendClient::error, this, [this, s](const QString& e){
+      err() << "  error: " << e << Qt::endl;
+      // "TTS: no audio" is followed by ready() right away (counted there); an
+      // LLM error ends the request here
+      QTimer::singleShot(0, this, [this, s]{
+        if (s->busy && !s->client->isBusy()) { ++errors_; complete(s, false); }
+      });
+    });
+    connect(s->client, &BackendClient::ready, this, [this, s, stamp](const BackendResult& r){
+      if (r.clauses > 0 && r.audioClips == 0) { ++noAudio_; complete(s, false); return; }
+      stamp(LatencyTrace::Finished);               // headless: "all audio received"
+      complete(s, true);
+    });
+    slots_ << s;
+    return s;
+  }
+
+  void send(Slot* s) {
+    if (sent_ >= opt_.count) return;
+    const QString text = work_.at(sent_ % work_.size());
+    ++sent_;
+    s->busy = true;
+    s->rec = Record{};
+    s->rec.us.fill(-1);
+    s->rec.wallMs = wall_.elapsed();
+    s->t.start();
+    s->timeout->start(opt_.timeoutMs);
+    s->rec.requestId = s->client->submit(text);
+  }
+
+  void complete(Slot* s, bool ok) {
+    if (!s->busy) return;
+    s->busy = false;
+    s->timeout->stop();
+    if (ok) done_ << s->rec;
+    ++finished_;
+    if (finished_ >= opt_.count) { report(); return; }
+    if (opt_.rate <= 0) send(s);                   // closed loop: next line right away
+  }
+
+  void report() {
+    cache_.save();
+    const double secs = wall_.elapsed() / 1000.0;
+    out() << QStringLiteral("requests %1  ok %2  errors %3  no-audio %4  timeouts %5  wall %6 s  throughput %7 req/s\n")
+               .arg(finished_).arg(done_.size()).arg(errors_).arg(noAudio_).arg(timeouts_)
+               .arg(secs, 0, 'f', 2).arg(secs > 0 ? done_.size() / secs : 0.0, 0, 'f', 3);
+    out() << QStringLiteral("%1 %2 %3 %4 %5 %6\n").arg("stage", -13).arg("n", 5)
+               .arg("p50", 9).arg("p95", 9).arg("p99", 9).arg("max", 9);
+
+    QJsonObject stages;
+    for (int i = LatencyTrace::LlmFirstByte; i < LatencyTrace::StageCount; ++i) {
+      const auto st = Stage(i);
+      int n = 0;
+      for (const auto& r : done_) if (r.us[st] >= 0) ++n;
+      if (n == 0) continue;                        // e.g. FirstSample: nothing plays here
+      const qint64 p50 = LatencyTrace::percentileUs(done_, st, 50);
+      const qint64 p95 = LatencyTrace::percentileUs(done_, st, 95);
+      const qint64 p99 = LatencyTrace::percentileUs(done_, st, 99);
+      const qint64 mx  = LatencyTrace::percentileUs(done_, st, 100);
+      out() << QStringLiteral("%1 %2 %3 %4 %5 %6\n").arg(LatencyTrace::stageName(st), -13).arg(n, 5)
+                 .arg(p50 / 1000.0, 9, 'f', 1).arg(p95 / 1000.0, 9, 'f', 1)
+                 .arg(p99 / 1000.0, 9, 'f', 1).arg(mx / 1000.0, 9, 'f', 1);
+      stages.insert(QLatin1String(LatencyTrace::stageName(st)), QJsonObject{
+        { "n", n }, { "p50_ms", p50 / 1000.0 }, { "p95_ms", p95 / 1000.0 },
+        { "p99_ms", p99 / 1000.0 }, { "max_ms", mx / 1000.0 } });
+    }
+    out().flush();
+
+    if (!opt_.jsonPath.isEmpty()) {
+      const QJsonObject rep{
+        { "requests", finished_ }, { "ok", int(done_.size()) }, { "errors", errors_ },
+        { "no_audio", noAudio_ }, { "timeouts", timeouts_ }, { "wall_s", secs },
+        { "throughput_rps", secs > 0 ? done_.size() / secs : 0.0 },
+        { "concurrency", opt_.rate > 0 ? 0 : opt_.concurrency }, { "rate", opt_.rate },
+        { "tts_cache", QJsonObject{ { "hits", qint64(cache_.hits()) },
+                                    { "misses", qint64(cache_.misses()) } } },
+        { "stages", stages } };
+      QSaveFile f(opt_.jsonPath);
+      if (f.open(QIODevice::WriteOnly)) {
+        f.write(QJsonDocument(rep).toJson());
+        f.commit();
+      }
+    }
+    QCoreApplication::exit(done_.isEmpty() ? 1 : 0);
+  }
+};
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setOrganizationName("nana14");
+  QCoreApplication::setApplicationName("luna-replay");   // own cache/settings, not the app's
+
+  QCommandLineParser p;
+  p.setApplicationDescription("Replay a JSONL workload against the LLM/TTS backends.");
+  p.addHelpOption();
+  p.addOption({ "llm", "LLM base URL.", "url", "http://127.0.0.1:8000" });
+  p.addOption({ "tts", "TTS base URL.", "url", "http://127.0.0.1:9880" });
+  p.addOption({ "concurrency", "Closed loop with N clients (default 1).", "n", "1" });
+  p.addOption({ "rate", "Open loop: requests per second.", "r" });
+  p.addOption({ "count", "Total requests (default: one pass over the file).", "n" });
+  p.addOption({ "timeout", "Per-request timeout in seconds (default 120).", "s", "120" });
+  p.addOption({ "no-stream", "Use /chat instead of /chat_stream." });
+  p.addOption({ "tts-cache", "Allow client-side TTS cache hits (off by default)." });
+  p.addOption({ "sessions", "One LLM session per client instead of stateless requests." });
+  p.addOption({ "json", "Also write the report as JSON.", "file" });
+  p.addPositionalArgument("workload", "JSONL file, one message per line.");
+  p.process(app);
+
+  if (p.positionalArguments().size() != 1) p.showHelp(2);
+  const QStringList work = readWorkload(p.positionalArguments().first());
+  if (work.isEmpty()) {
+    err() << "no messages in " << p.positionalArguments().first() << Qt::endl;
+    return 2;
+  }
+
+  Replay::Options o;
+  o.llm         = QUrl(p.value("llm"));
+  o.tts         = QUrl(p.value("tts"));
+  o.concurrency = qMax(1, p.value("concurrency").toInt());
+  o.rate        = p.value("rate").toDouble();
+  o.count       = p.isSet("count") ? qMax(1, p.value("count").toInt()) : work.size();
+  o.timeoutMs   = qMax(1, p.value("timeout").toInt()) * 1000;
+  o.streaming   = !p.isSet("no-stream");
+  o.ttsCache    = p.isSet("tts-cache");
+  o.sessions    = p.isSet("sessions");
+  o.jsonPath    = p.value("json");
+
+  Replay replay(o, work);
+  QTimer::singleShot(0, &replay, [&replay]{ replay.start(); });
+  return app.exec();
+}
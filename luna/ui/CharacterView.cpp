@@ -16,9 +16,17 @@ Optional hover animation or slight bob (QPropertyAnimation) later. (what animati
 #include <QPainter>
 #include <QPaintEvent>
 #include <QMouseEvent>
+#include <QPixmapCache>
+#include <QTimer>
+#include <QTransform>
 #include <QtMath>
 #include <algorithm>
 
+// idle time after the last scale step before we re-render with smooth filtering
+static constexpr int kZoomSettleMs = 160;
+// room for a mode's worth of scaled frames + mip levels (KB)
+static constexpr int kPixmapCacheKB = 96 * 1024;
+
 CharacterView::CharacterView(ModeManager* modes, QWidget* parent)
   : QWidget(parent), modes_(modes)
 {
@@ -27,30 +35,49 @@ CharacterView::CharacterView(ModeManager* modes, QWidget* parent)
 
   connect(modes_, &ModeManager::frameChanged, this, [this](int){ updateFromManager(); });
   connect(modes_, &ModeManager::modeChanged,  this, [this](const QString&){ updateFromManager(); });
+  connect(modes_, &ModeManager::cropChanged,  this, [this](const QRect&){ updateFromManager(); });
+  connect(modes_, &ModeManager::imageReady,   this, [this](int i){
+    if (i == modes_->currentIndex()) update();   // placeholder -> real frame
+  });
+
+  if (QPixmapCache::cacheLimit() < kPixmapCacheKB)
+    QPixmapCache::setCacheLimit(kPixmapCacheKB);
+
+  settleTimer_ = new QTimer(this);
+  settleTimer_->setSingleShot(true);
+  settleTimer_->setInterval(kZoomSettleMs);
+  connect(settleTimer_, &QTimer::timeout, this, [this]{
+    zooming_ = false;
+    update();                                  // repaint once with the smooth scale
+  });
 }
 
 // SINGLE definition — clamp to 50%..100%
 void CharacterView::setScale(qreal s) {
-  scale_ = std::clamp<qreal>(s, 0.5, 1.0);
+  s = std::clamp<qreal>(s, 0.5, 1.0);
+  if (qFuzzyCompare(s, scale_)) return;
+  scale_ = s;
+  if (isVisible()) { zooming_ = true; settleTimer_->start(); }
   updateGeometry();
   update();
 }
 
 QSize CharacterView::sizeHint() const {
-  const QImage img = modes_->currentImage();
-  if (!img.isNull()) {
-    const int w = qMax(1, qRound(img.width()  * scale_));
-    const int h = qMax(1, qRound(img.height() * scale_));
+  // widget == the mode's opaque union box, not the whole transparent canvas
+  const QSize src = modes_->cropRect().size();   // header index, no decode
+  if (src.isValid() && !src.isEmpty()) {
+    const int w = qMax(1, qRound(src.width()  * scale_));
+    const int h = qMax(1, qRound(src.height() * scale_));
     return QSize(w, h);
   }
   return QSize(qRound(320 * scale_), qRound(360 * scale_));
 }
 
 QRect CharacterView::imageRect() const {
-  const QImage img = modes_->currentImage();
-  if (!img.isNull()) {
-    const int w = qMax(1, qRound(img.width()  * scale_));
-    const int h = qMax(1, qRound(img.height() * scale_));
+  const QSize src = modes_->cropRect().size();
+  if (src.isValid() && !src.isEmpty()) {
+    const int w = qMax(1, qRound(src.width()  * scale_));
+    const int h = qMax(1, qRound(src.height() * scale_));
     const int x = (width()  - w) / 2;
     const int y = (height() - h) / 2;
     return QRect(x, y, w, h);
@@ -59,16 +86,48 @@ QRect CharacterView::imageRect() const {
   return QRect((width()-tgt.width())/2, (height()-tgt.height())/2, tgt.width(), tgt.height());
 }
 
+QRect CharacterView::canvasRect() const {
+  const QRect crop   = modes_->cropRect();
+  const QSize canvas = modes_->currentFrameSize();
+  const QRect r      = imageRect();
+  if (crop.isEmpty() || !canvas.isValid()) return r;
+  return QRect(r.x() - qRound(crop.x() * scale_), r.y() - qRound(crop.y() * scale_),
+               qRound(canvas.width() * scale_), qRound(canvas.height() * scale_));
+}
+
+QRegion CharacterView::spriteMask() const {
+  const QRegion mask = modes_->currentHitMask();
+  const QRect   crop = modes_->cropRect();
+  if (mask.isEmpty() || crop.isEmpty()) return QRegion(rect());   // not decoded yet
+
+  // canvas coords -> cropped, scaled widget coords
+  const QRect r = imageRect();
+  QTransform t;
+  t.translate(r.x(), r.y());
+  t.scale(scale_, scale_);
+  t.translate(-crop.x(), -crop.y());
+  QRegion m = t.map(mask);
+  if (!qFuzzyCompare(scale_, 1.0)) {
+    // scaled edges round to the nearest pixel; this region is the window
+    // shape, so grow it by one rather than clip a sliver of the sprite
+    m += m.translated(1, 0) + m.translated(-1, 0);
+    m += m.translated(0, 1) + m.translated(0, -1);
+  }
+  return m.intersected(rect());
+}
+
 void CharacterView::paintEvent(QPaintEvent*) {
   QPainter p(this);
-  p.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform, true);
 
   const QImage img = modes_->currentImage();
   const QRect r = imageRect();
 
   if (!img.isNull()) {
-    p.drawImage(r, img);
+    // already at device resolution: plain 1:1 blit, no per-paint resampling
+    const QRect crop = modes_->cropRect().intersected(img.rect());
+    p.drawPixmap(r.topLeft(), scaledPixmap(img, crop.isEmpty() ? img.rect() : crop, r.size()));
   } else {
+    p.setRenderHint(QPainter::Antialiasing, true);
     p.setPen(Qt::NoPen);
     p.setBrush(QColor(0,0,0,60));
     p.drawEllipse(QRect(r.center().x()-80, r.bottom()-40, 160, 24));
@@ -89,3 +148,59 @@ void CharacterView::updateFromManager() {
   updateGeometry();
   update();
 }
+
+QPixmap CharacterView::scaledPixmap(const QImage& img, const QRect& crop, const QSize& logical) {
+  const qreal dpr = devicePixelRatioF();
+  const QSize dev(qMax(1, qRound(logical.width()  * dpr)),
+                  qMax(1, qRound(logical.height() * dpr)));
+
+  const QString srcKey = QStringLiteral("luna:%1:%2,%3,%4x%5").arg(img.cacheKey())
+                           .arg(crop.x()).arg(crop.y()).arg(crop.width()).arg(crop.height());
+  const QString key = srcKey + QStringLiteral(":%1x%2").arg(dev.width()).arg(dev.height());
+  const QString fastKey = key + QStringLiteral(":fast");
+
+  QPixmap pm;
+  if (QPixmapCache::find(key, &pm)) return pm;              // smooth version wins
+  if (zooming_ && QPixmapCache::find(fastKey, &pm)) return pm;
+
+  // zero-copy view of the cropped region (only lives for this call)
+  const QImage src = (crop == img.rect())
+                   ? img
+                   : QImage(img.constScanLine(crop.y()) + crop.x() * 4, crop.width(), crop.height(),
+                            img.bytesPerLine(), img.format());
+
+  if (zooming_) {
+    // mid-gesture: nearest mip level >= target, cheap nearest-neighbour step
+    pm = mipLevel(src, srcKey, dev).scaled(dev, Qt::IgnoreAspectRatio, Qt::FastTransformation);
+    pm.setDevicePixelRatio(dpr);
+    QPixmapCache::insert(fastKey, pm);
+    return pm;
+  }
+
+  pm = (dev == src.size())
+     ? QPixmap::fromImage(src)
+     : QPixmap::fromImage(src.scaled(dev, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+  pm.setDevicePixelRatio(dpr);
+  QPixmapCache::insert(key, pm);
+  return pm;
+}
+
+QPixmap CharacterView::mipLevel(const QImage& img, const QString& srcKey, const QSize& atLeast) {
+  // levels: 1, 1/2, 1/4 ... of the source; pick the smallest still >= target
+  int level = 0;
+  QSize sz = img.size();
+  while (sz.width() / 2 >= atLeast.width() && sz.height() / 2 >= atLeast.height()
+         && sz.width() / 2 > 0 && sz.height() / 2 > 0) {
+    sz /= 2;
+    ++level;
+  }
+
+  const QString key = srcKey + QStringLiteral(":mip%1").arg(level);
+  QPixmap pm;
+  if (QPixmapCache::find(key, &pm)) return pm;
+  pm = (level == 0)
+     ? QPixmap::fromImage(img)
+     : QPixmap::fromImage(img.scaled(sz, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+  QPixmapCache::insert(key, pm);
+  return pm;
+}
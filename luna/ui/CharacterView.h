@@ -7,10 +7,13 @@
 #pragma once
 #include <QWidget>
 #include <QImage>
+#include <QPixmap>
 #include <QRect>
+#include <QRegion>
 #include <QSize>
 
 class ModeManager;
+class QTimer;
 
 class CharacterView : public QWidget {
   Q_OBJECT
@@ -21,7 +24,9 @@ public:
   qreal scale() const { return scale_; }
 
   QSize sizeHint() const override;
-  QRect imageRect() const;                 // where the sprite is drawn
+  QRect imageRect() const;                 // where the (cropped) sprite is drawn
+  QRect canvasRect() const;                // where the full canvas would be (may exceed the widget)
+  QRegion spriteMask() const;              // visible (= clickable) pixels of the current frame, widget coords
 
 signals:
   void leftClicked();
@@ -35,5 +40,13 @@ private:
   ModeManager* modes_;
   qreal        scale_ = 1.0;
 
+  // Alt+wheel gesture: fast transforms while zooming_, smooth once settled
+  QTimer*      settleTimer_ = nullptr;
+  bool         zooming_     = false;
+
   void updateFromManager();
+
+  // frame pre-scaled to `logical` at the current DPR (QPixmapCache-backed)
+  QPixmap scaledPixmap(const QImage& img, const QRect& crop, const QSize& logical);
+  QPixmap mipLevel(const QImage& img, const QString& srcKey, const QSize& atLeast);
 };
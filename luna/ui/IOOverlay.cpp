@@ -10,9 +10,14 @@ Style:
   QSS: transparent background, white text with drop shadow, rounded subtle border when focused.
 
 Flow:
-  On Enter: emit submitted(text), clear line edit, switch to “status” display ("LUNA …" or a subtle spinner), disable input.
-  When backend returns: set display to LLM text, keep disabled.
-  AudioPlayer emits finished: hide display, re-enable input.
+  On Enter: emit submitted(text), clear line edit, switch to “status” display ("LUNA …" or a subtle spinner).
+  When backend returns: set display to LLM text.
+  AudioPlayer emits finished: hide display, back to the full-size input.
+
+Type-ahead: in output mode the editor stays enabled as one row under the
+text, so the next message can be written (and sent: submitted() again,
+MainWindow queues it) while Luna is still talking. Unsent text survives
+the switch back to input mode.
 
 */
 #include "IOOverlay.h"
@@ -64,8 +69,10 @@ bool IOOverlay::eventFilter(QObject* obj, QEvent* ev) {
     if (justEnter) {
       const QString t = edit_->toPlainText().trimmed();
       if (!t.isEmpty()) {
+        edit_->clear();
+        const bool typeAhead = output_;            // current reply stays on screen
         emit submitted(t);
-        toOutput(QString::fromUtf8("…"));
+        if (!typeAhead) toOutput(QString::fromUtf8("…"));
       }
       return true;  // consume
     }
@@ -77,7 +84,7 @@ bool IOOverlay::eventFilter(QObject* obj, QEvent* ev) {
 void IOOverlay::setNames(const QString& userName, const QString& charName) {
   userName_ = userName;
   charName_ = charName;
-  header_->setText(QStringLiteral("【%1】").arg(edit_->isEnabled()? userName_ : charName_));
+  header_->setText(QStringLiteral("【%1】").arg(output_ ? charName_ : userName_));
 }
 
 void IOOverlay::setBounds(const QRect& r) {
@@ -87,28 +94,35 @@ void IOOverlay::setBounds(const QRect& r) {
   update();
 }
 
+void IOOverlay::setPlaceholder(const QString& text) { edit_->setPlaceholderText(text); }
+
 void IOOverlay::showStatus(const QString& text) { toOutput(text); }
 void IOOverlay::showOutput(const QString& text) { toOutput(text); }
+void IOOverlay::showPartial(const QString& text) {
+  // called per token: skip the relayout once we're already showing output
+  if (output_ && body_->isVisible()) body_->setText(text);
+  else toOutput(text);
+}
 void IOOverlay::backToInputMode()               { toInput();      }
 
 void IOOverlay::toInput() {
+  output_ = false;
   body_->setVisible(false);
   edit_->setEnabled(true);
   edit_->setVisible(true);
   header_->setText(QStringLiteral("【%1】").arg(userName_));
-  edit_->clear();
-  edit_->setFocus();
+  edit_->setFocus();                                 // anything typed ahead is kept
   layoutChildren();
   update();
 }
 
 void IOOverlay::toOutput(const QString& text) {
-  edit_->setEnabled(false);
-  edit_->setVisible(false);
+  const bool relayout = !output_;
+  output_ = true;
   body_->setVisible(true);
   body_->setText(text);
   header_->setText(QStringLiteral("【%1】").arg(charName_));
-  layoutChildren();
+  if (relayout) layoutChildren();
   update();
 }
 
@@ -123,10 +137,14 @@ void IOOverlay::layoutChildren() {
   const int contentTop = pad + headerH;
   const int contentH   = std::max(12, h - contentTop - pad);
 
-  if (edit_->isVisible())
+  if (!output_) {
     edit_->setGeometry(pad, contentTop, w - 2*pad, contentH);
-  if (body_->isVisible())
-    body_->setGeometry(pad, contentTop, w - 2*pad, contentH);
+    return;
+  }
+  // output: the reply on top, one type-ahead row at the bottom
+  const int rowH = std::min(contentH / 2, edit_->fontMetrics().height() + 6);
+  body_->setGeometry(pad, contentTop, w - 2*pad, contentH - rowH);
+  edit_->setGeometry(pad, contentTop + contentH - rowH, w - 2*pad, rowH);
 }
 
 void IOOverlay::updateFonts() {
@@ -19,7 +19,9 @@ public:
   void setNames(const QString& userName, const QString& charName);
   void showStatus(const QString& text);
   void showOutput(const QString& text);
+  void showPartial(const QString& text);   // streaming: just swap the body text
   void backToInputMode();
+  void setPlaceholder(const QString& text);   // input hint (e.g. backend readiness)
 
 signals:
   void submitted(const QString& userText);
@@ -34,6 +36,8 @@ private:
   QLabel*    header_= nullptr;
   QLabel*    body_  = nullptr;
 
+  bool       output_ = false;    // body shown; edit_ shrinks to a type-ahead row
+
   QString userName_ = QString::fromUtf8("あなた");
   QString charName_ = QString::fromUtf8("桜小路ルナ");
 
@@ -22,6 +22,9 @@ Snap to corner on first run; Draggable by left-button drag on anywhere of the co
 #include "../core/ModeManager.h"
 #include "../core/BackendClient.h"
 #include "../core/AudioPlayer.h"
+#include "../core/BackendSupervisor.h"
+#include "../core/LatencyTrace.h"
+#include "StatsPanel.h"
 
 #include <QAbstractScrollArea>
 
@@ -40,6 +43,9 @@ Snap to corner on first run; Draggable by left-button drag on anywhere of the co
 #include <QMouseEvent>
 #include <QTimer>
 #include <QCursor>
+#include <QDateTime>
+#include <QStandardPaths>
+#include <QToolTip>
 #include <QStyleHints>
 #include <QSettings>
 #include <functional>
@@ -49,7 +55,6 @@ Snap to corner on first run; Draggable by left-button drag on anywhere of the co
 #include <QEasingCurve>
 
 #define SMIRK_PROB 60
-#define TEXT_WAIT 4000
 
 
 // tiny helpers to persist the drag modifier
@@ -89,6 +94,7 @@ MainWindow::MainWindow(QWidget* parent) : QWidget(parent) {
   audio_ = new AudioPlayer(this);
   emoCtrl_   = new EmotionSpriteController(modes_, this);  // loads summary.json automatically
   io_        = new IOOverlay(this);
+  conv_      = new Conversation(this);
   io_->setNames(QString::fromUtf8("NANA"), QString::fromUtf8("桜小路ルナ"));
   io_->raise(); // overlay on top
 
@@ -102,6 +108,10 @@ MainWindow::MainWindow(QWidget* parent) : QWidget(parent) {
 
   // 4) Load settings (drag modifier + initial scale)
   dragMod_ = keyToMod(QSettings().value("dragModifier", "Alt").toString());
+  // optional: one CSV row per conversation turn (see LatencyTrace)
+  if (QSettings().value("latencyLog", false).toBool())
+    LatencyTrace::instance().setLogFile(
+        QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/latency.csv");
   {
     const qreal s = QSettings().value("uiScale", 1.0).toDouble();
     character_->setScale(s);            // 50%..100% clamp happens inside setScale
@@ -137,6 +147,7 @@ MainWindow::MainWindow(QWidget* parent) : QWidget(parent) {
   connect(idleTimer_, &QTimer::timeout, this, [this]{
     faded_ = true;
     io_->setVisible(false);        // textbox disappears
+    updateInputMask();
     fadeTo(0.5);                   // sprite to 50%
   });
 
@@ -173,87 +184,96 @@ void MainWindow::connectSignals() {
   backend_->setTtsBaseUrl(QUrl(QStringLiteral("http://127.0.0.1:9880"))); // your SoVITS
   backend_->setTextLang(QStringLiteral("ja"));
 
+  // backend readiness -> input hint (typing is still allowed; it just may fail)
+  connect(backend_->supervisor(), &BackendSupervisor::stateChanged, this, [this]{
+    using S = BackendSupervisor::Service;
+    const auto* sup = backend_->supervisor();
+    if (!sup->isUp(S::Llm))      io_->setPlaceholder(QStringLiteral("Waiting for LUNA (LLM) …"));
+    else if (!sup->isUp(S::Tts)) io_->setPlaceholder(QStringLiteral("Type and press Enter… (voice offline)"));
+    else                         io_->setPlaceholder(QStringLiteral("Type and press Enter…"));
+  });
+
+  // every turn goes through conv_: signals below only post events, the
+  // reactions live in onTransition()
+  connect(conv_, &Conversation::transitioned, this, &MainWindow::onTransition);
+
   connect(io_, &IOOverlay::submitted, this, [this](const QString& text){
-    // IOOverlay already switched to "…" (output mode, disabled)
-    backend_->submit(text);
+    // input mode: IOOverlay already switched to "…"; type-ahead: the current
+    // line stays up and this one waits its turn
+    queued_ << text;
+    pumpQueue();
   });
 
+  // everything a reply shows or plays goes through present(): while the
+  // previous line is still being spoken it is held back, then replayed
   connect(backend_, &BackendClient::status, this, [this](const QString& s){
-    io_->showStatus(s);          // keep showing "LUNA …"
+    if (deferOutput_) deferredText_ = s;
+    else              io_->showStatus(s);          // keep showing "LUNA …"
   });
 
-  connect(backend_, &BackendClient::ready, this, [this](const BackendResult& r){
-    io_->showOutput(r.echoText);
-
-    bool audioStarted = false;
-    if (r.audioUrl.isValid())      { audio_->play(r.audioUrl);      audioStarted = true; }
-    else if (r.localFile.isValid()){ audio_->play(r.localFile);     audioStarted = true; }
-
-    startReenableGate(audioStarted);
+  // streaming: the line appears as the model writes it
+  connect(backend_, &BackendClient::partialText, this, [this](const QString& s){
+    if (deferOutput_) deferredText_ = s;
+    else              io_->showPartial(s);
   });
 
   connect(backend_, &BackendClient::ready, this, [this](const BackendResult& r){
-    io_->showOutput(r.echoText);
-
-    if (!r.emotion.isEmpty())
-      emoCtrl_->applyEmotion(r.emotion.trimmed());
-
-    bool audioStarted = false;
-    if (r.audioUrl.isValid())      { audio_->play(r.audioUrl);      audioStarted = true; }
-    else if (r.localFile.isValid()){ audio_->play(r.localFile);     audioStarted = true; }
-
-    startReenableGate(audioStarted);
+    present([this, r]{
+      reply_ = r;
+      conv_->post(Conversation::Event::Reply);
+    });
+    QTimer::singleShot(0, this, [this]{ pumpQueue(); });   // backend is free again
   });
 
-  connect(backend_, &BackendClient::emotionAvailable,
-        emoCtrl_,  &EmotionSpriteController::applyEmotion);
-
-
-  // keep your existing gating connection; add a second connection for the smirk:
-  connect(audio_, &AudioPlayer::finished, this, [this]{
-    if (emoCtrl_) emoCtrl_->maybeSmirk(SMIRK_PROB);  // 30% chance
+  // one face per reply: "<E:thinking>" on submit, the reply's own once known
+  connect(backend_, &BackendClient::emotionAvailable, this, [this](const QString& e){
+    if (deferOutput_) deferredEmotion_ = e;
+    else              emoCtrl_->applyEmotion(e);
   });
 
-  connect(emoCtrl_, &EmotionSpriteController::frameChosen, this, [this](const QString& p){
-    // qDebug() << "[ui] face path =" << p;
-    // Or surface it briefly in the overlay:
-    // io_->showStatus(QStringLiteral("face → %1").arg(p));
+  // clause pipeline: first clause plays while the rest is still synthesizing
+  connect(backend_, &BackendClient::clauseAudio, this, [this](const QUrl& u){
+    present([this, u]{ audio_->enqueue(u); });
   });
+  connect(backend_, &BackendClient::pcmFormat, this, [this](int rate, int ch){
+    present([this, rate, ch]{ audio_->pcmBegin(rate, ch); });
+  });
+  connect(backend_, &BackendClient::pcmData, this, [this](const QByteArray& pcm){
+    present([this, pcm]{ audio_->pcmAppend(pcm); });
+  });
+  // superseded/cancelled reply: whatever of it is queued must not play
+  connect(backend_, &BackendClient::cancelled, audio_, [this](int){ audio_->stop(); });
 
-  connect(backend_, &BackendClient::emotionAvailable,
-        emoCtrl_,   &EmotionSpriteController::applyEmotion);
-
-
-
-  // backend end
+  connect(audio_, &AudioPlayer::finished, this, [this]{
+    conv_->post(Conversation::Event::AudioDone);
+  });
 
-  // errors
+  // errors: shown right away; the state decides whether the turn ends
   connect(audio_, &AudioPlayer::error, this, [this](const QString& e){
     io_->showStatus(QStringLiteral("⚠ %1").arg(e));
-    // Treat as audio finished; keep 3s minimum if not elapsed yet
-    gateAudioDone_ = true;
-    // wait 3 seconds
-    QTimer::singleShot(TEXT_WAIT, this, [this]{
-      finishGateNow();
-    });
+    conv_->post(Conversation::Event::Silent);
   });
 
   connect(backend_, &BackendClient::error, this, [this](const QString& e){
-    io_->showStatus(QStringLiteral("⚠ %1").arg(e));
-    // No audio will play; just fall back to 3s timer (already running with audioStarted=false)
-    gateAudioDone_ = true;
-    // wait 3 seconds
-    QTimer::singleShot(TEXT_WAIT, this, [this]{
-      finishGateNow();
+    present([this, e]{
+      io_->showStatus(QStringLiteral("⚠ %1").arg(e));
+      conv_->post(Conversation::Event::Failed);   // no-op once the text is up
     });
+    QTimer::singleShot(0, this, [this]{ pumpQueue(); });
   });
 
+  // backend end
 
   // keep overlay glued to sprite; also resize window to the sprite
   connect(modes_, &ModeManager::modeChanged,  this, [this](const QString&){ syncWindowToSprite(); });
 
 
   connect(modes_, &ModeManager::frameChanged, this, [this](int){            syncWindowToSprite(); });
+  // all boxes known -> window shrinks to the character; new pixels -> new hit mask
+  connect(modes_, &ModeManager::cropChanged,  this, [this](const QRect&){   syncWindowToSprite(); });
+  connect(modes_, &ModeManager::imageReady,   this, [this](int i){
+    if (i == modes_->currentIndex()) updateInputMask();
+  });
 }
 
 void MainWindow::showEvent(QShowEvent* e) {
@@ -412,6 +432,38 @@ void MainWindow::showContextMenu(const QPoint& globalPos) {
   auto* dragMenu  = menu.addMenu("Drag Binding");
   populateDragBindingMenu(dragMenu);
 
+  // Enter -> speech timings (p50/p95 per stage)
+  auto* statsMenu = menu.addMenu("Latency");
+  QAction* showStats = statsMenu->addAction("Show Stats");
+  showStats->setCheckable(true);
+  showStats->setChecked(stats_ && stats_->isVisible());
+  connect(showStats, &QAction::toggled, this, [this](bool on){
+    if (!stats_) stats_ = new StatsPanel(this);
+    if (on) {
+      stats_->move(frameGeometry().topLeft() - QPoint(stats_->sizeHint().width() + 8, 0));
+      stats_->show();
+    } else {
+      stats_->hide();
+    }
+  });
+  statsMenu->addAction("Export CSV", this, [this]{
+    const QString path = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                       + QStringLiteral("/latency-%1.csv")
+                           .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+    const bool ok = LatencyTrace::instance().exportCsv(path);
+    QToolTip::showText(QCursor::pos(), ok ? QStringLiteral("Saved %1").arg(path)
+                                          : QStringLiteral("Could not write %1").arg(path));
+  });
+
+  if (backend_->isBusy() || audio_->isActive()) {
+    // drop the reply in progress: aborts LLM/TTS requests, silences audio
+    menu.addAction("Stop", this, [this]{
+      dropQueued();                            // typed-ahead messages go too
+      backend_->cancel();
+      conv_->post(Conversation::Event::Cancel);
+    });
+  }
+
   menu.addSeparator();
   menu.addAction("Close", []{ qApp->quit(); });
   menu.exec(globalPos);
@@ -460,6 +512,10 @@ void MainWindow::setDragModifier(Qt::KeyboardModifier mod, bool persist) {
 }
 
 void MainWindow::syncWindowToSprite() {
+  // frames of a mode share one canvas size, so most frame switches are a no-op
+  const QSize want = character_->sizeHint();   // FrameIndex lookup, no decode
+  if (want == size() && character_->size() == want) { updateInputMask(); return; }
+
   keepBottomRightAnchor(this, [this]{
     character_->adjustSize();
     setFixedSize(character_->sizeHint());    // window = sprite size
@@ -469,17 +525,18 @@ void MainWindow::syncWindowToSprite() {
 
 void MainWindow::updateIoGeometry() {
   const QRect imgLocal = character_->imageRect();
-  if (imgLocal.isEmpty()) { io_->setBounds(QRect()); return; }
+  if (imgLocal.isEmpty()) { io_->setBounds(QRect()); updateInputMask(); return; }
 
   const QPoint tl = character_->mapTo(this, imgLocal.topLeft());
-  const QRect  img(tl, imgLocal.size());      // scaled PNG rect in MainWindow coords
+  const QRect  img(tl, imgLocal.size());      // scaled, cropped sprite rect in MainWindow coords
+  const QSize  canvas = character_->canvasRect().size();   // panel proportions follow the full PNG
 
   constexpr double kWidthRatio  = 0.40;       // 50% of PNG width
   constexpr double kHeightRatio = 0.25;       // about 25% of PNG height for the panel
   constexpr int    kMinH        = 60;
 
-  const int w = std::max(1, int(img.width()  * kWidthRatio));
-  const int h = std::max(kMinH, int(img.height() * kHeightRatio));
+  const int w = std::min(img.width(), std::max(1, int(canvas.width() * kWidthRatio)));
+  const int h = std::min(img.height(), std::max(kMinH, int(canvas.height() * kHeightRatio)));
 
   const int x = img.left() + (img.width() - w) / 2;   // center horizontally
   const int y = img.bottom() - h+5;                 // anchor to bottom
@@ -488,6 +545,17 @@ void MainWindow::updateIoGeometry() {
   box.adjust(0, 4, 0, -4);                            // tiny vertical breathing room
 
   io_->setBounds(box);
+  updateInputMask();
+}
+
+void MainWindow::updateInputMask() {
+  // sprite alpha mask (cell-granular) + the textbox while it is shown. On a
+  // top-level this is the window shape (it clips painting as well), so the
+  // sprite mask covers every pixel with alpha > 0, see FrameIndex::kHitAlpha
+  QRegion m = character_->spriteMask().translated(character_->pos());
+  if (io_->isVisible()) m += io_->geometry();
+  if (m.isEmpty()) clearMask();
+  else             setMask(m);
 }
 
 void MainWindow::fadeTo(qreal target) {
@@ -510,42 +578,89 @@ void MainWindow::cancelIdleFadeAndRestore() {
   if (faded_) {
     faded_ = false;
     io_->setVisible(true);   // textbox reappears
+    updateInputMask();
     fadeTo(1.0);             // sprite back to full opacity
   }
 }
 
 
-void MainWindow::finishGateNow() {
-  if (gateTimer_) { gateTimer_->stop(); gateTimer_->deleteLater(); gateTimer_ = nullptr; }
-  if (gateConn_)  { disconnect(gateConn_); gateConn_ = {}; }
-  io_->backToInputMode();
+void MainWindow::onTransition(Conversation::State from, Conversation::State to,
+                              Conversation::Event ev) {
+  using S = Conversation::State;
+  using E = Conversation::Event;
+  switch (to) {
+  case S::Thinking:
+    // IOOverlay is already showing "…" (or the previous line, typed ahead)
+    break;
+
+  case S::Speaking:
+    io_->showOutput(reply_.echoText);
+    if (!startPlayback(reply_)) conv_->post(E::Silent);
+    break;
+
+  case S::Holding:
+    // the next reply is already (being) prepared: straight on, no hold
+    if (deferOutput_) { flushDeferred(); break; }
+    if (from == S::Speaking && ev == E::AudioDone && emoCtrl_)
+      emoCtrl_->maybeSmirk(SMIRK_PROB);
+    break;
+
+  case S::Idle:
+    io_->backToInputMode();                  // Cancel: cancelled() already stopped audio
+    break;
+  }
 }
 
-void MainWindow::tryFinishGate() {
-  if (gateAudioDone_ && gateTimerDone_) finishGateNow();
+bool MainWindow::startPlayback(const BackendResult& r) {
+  if (r.audioClips > 0) {
+    // clauses were queued as they came in; finished() after the last one
+    // (right away if it already ended)
+    audio_->closeQueue();
+    return true;
+  }
+  if (r.audioUrl.isValid())  { audio_->play(r.audioUrl);  return true; }
+  if (r.localFile.isValid()) { audio_->play(r.localFile); return true; }
+  return false;
 }
 
-void MainWindow::startReenableGate(bool audioStarted) {
-  // reset previous gate
-  if (gateTimer_) { gateTimer_->stop(); gateTimer_->deleteLater(); gateTimer_ = nullptr; }
-  if (gateConn_)  { disconnect(gateConn_); gateConn_ = {}; }
-  gateAudioDone_ = !audioStarted;   // if no audio, treat as already done
-  gateTimerDone_ = false;
-
-  // 3s minimum hold
-  gateTimer_ = new QTimer(this);
-  gateTimer_->setSingleShot(true);
-  gateTimer_->start(TEXT_WAIT);
-  connect(gateTimer_, &QTimer::timeout, this, [this]{
-    gateTimerDone_ = true;
-    tryFinishGate();
-  });
-
-  // audio finished (only if started)
-  if (audioStarted) {
-    gateConn_ = connect(audio_, &AudioPlayer::finished, this, [this]{
-      gateAudioDone_ = true;
-      tryFinishGate();
-    });
+void MainWindow::pumpQueue() {
+  // one request at a time, and at most one turn ahead of the spoken line
+  if (queued_.isEmpty() || backend_->isBusy() || deferOutput_) return;
+  const QString text = queued_.takeFirst();
+  // still talking: LLM + TTS start now, the result is shown/played after her line
+  if (conv_->state() == Conversation::State::Speaking) {
+    deferOutput_ = true;
+    LatencyTrace::instance().setAudioHeld(true);
+  } else {
+    conv_->post(Conversation::Event::Submit);
   }
+  backend_->submit(text);
+}
+
+void MainWindow::present(std::function<void()> fn) {
+  if (deferOutput_) deferred_ << std::move(fn);
+  else              fn();
+}
+
+void MainWindow::flushDeferred() {
+  deferOutput_ = false;
+  LatencyTrace::instance().setAudioHeld(false);
+  conv_->post(Conversation::Event::Submit);   // Holding -> Thinking, before any Reply below
+  if (!deferredEmotion_.isEmpty()) emoCtrl_->applyEmotion(deferredEmotion_);
+  if (!deferredText_.isEmpty())    io_->showPartial(deferredText_);
+  deferredEmotion_.clear();
+  deferredText_.clear();
+  const auto calls = std::move(deferred_);
+  deferred_.clear();
+  for (const auto& f : calls) f();            // clips start playing right away
+  QTimer::singleShot(0, this, [this]{ pumpQueue(); });
+}
+
+void MainWindow::dropQueued() {
+  queued_.clear();
+  deferred_.clear();
+  deferredEmotion_.clear();
+  deferredText_.clear();
+  deferOutput_ = false;
+  LatencyTrace::instance().setAudioHeld(false);
 }
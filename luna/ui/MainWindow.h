@@ -7,7 +7,11 @@
 #pragma once
 #include <QWidget>
 #include <QPoint>
+#include <QStringList>
+#include <functional>
 #include "../core/EmotionSpriteController.h"   // ⬅ add this include
+#include "../core/BackendClient.h"             // BackendResult
+#include "../core/Conversation.h"
 
 class CharacterView;
 class IOOverlay;
@@ -16,8 +20,8 @@ class QMenu;
 class QTimer;
 class QPropertyAnimation;
 class QGraphicsOpacityEffect;
-class BackendClient;     // <-- add
 class AudioPlayer;       // <-- add
+class StatsPanel;
 
 class MainWindow : public QWidget {
   Q_OBJECT
@@ -43,6 +47,8 @@ private:
   BackendClient* backend_   = nullptr;   // <-- add this
   AudioPlayer*   audio_     = nullptr;   // <-- add this
 
+  StatsPanel*    stats_     = nullptr;   // latency panel (context menu), created on demand
+
   // NEW: Emotional controller
   EmotionSpriteController* emoCtrl_ = nullptr; // ⬅ ADD HERE
 
@@ -52,15 +58,25 @@ private:
   QPoint dragOffset_;
   Qt::KeyboardModifier dragMod_ = Qt::AltModifier;   // configurable
 
-  // audio 
-  QTimer* gateTimer_ = nullptr;
-  QMetaObject::Connection gateConn_;
-  bool gateAudioDone_ = false;
-  bool gateTimerDone_ = false;
+  // one turn: Idle -> Thinking -> Speaking -> Holding -> Idle
+  Conversation* conv_  = nullptr;
+  BackendResult reply_;                 // the turn's result, for entering Speaking
+
+  void onTransition(Conversation::State from, Conversation::State to, Conversation::Event ev);
+  bool startPlayback(const BackendResult& r);   // false: nothing will play
+
+  // type-ahead: messages wait here while the backend is busy; one turn may
+  // run ahead of the line being spoken, its output held until that line ends
+  QStringList                  queued_;
+  bool                         deferOutput_ = false;
+  QList<std::function<void()>> deferred_;       // audio + ready/error, in order
+  QString                      deferredEmotion_; // only the last one matters
+  QString                      deferredText_;    // status / partial line, same
 
-  void startReenableGate(bool audioStarted);
-  void finishGateNow();      // actually flips UI once both conditions met
-  void tryFinishGate();      // checks the two flags
+  void pumpQueue();                             // send the next message if we can
+  void present(std::function<void()> fn);       // now, or after the current line
+  void flushDeferred();
+  void dropQueued();
 
 
   // Fades on 10s inactivity
@@ -77,5 +93,6 @@ private:
   void populateDragBindingMenu(QMenu* menu);
   void updateIoGeometry();       // place IOOverlay over bottom 40% of sprite
   void syncWindowToSprite();     // window size == sprite size; keep bottom-right
+  void updateInputMask();        // clicks pass through transparent pixels
   void setDragModifier(Qt::KeyboardModifier mod, bool persist = true);
 };
@@ -0,0 +1,63 @@
+/*
+
+StatsPanel
+
+Toggled from the context menu. Re-reads LatencyTrace once a second while
+visible (a snapshot copy; the pipeline is never blocked by it).
+
+*/
+
+#include "StatsPanel.h"
+#include "../core/LatencyTrace.h"
+#include <QFontDatabase>
+#include <QLabel>
+#include <QPainter>
+#include <QTimer>
+#include <QVBoxLayout>
+
+static constexpr int kRefreshMs = 1000;
+
+StatsPanel::StatsPanel(QWidget* parent)
+  : QWidget(parent, Qt::Tool | Qt::FramelessWindowHint | Qt::WindowStaysOnTopHint)
+{
+  setAttribute(Qt::WA_TranslucentBackground, true);
+  setAttribute(Qt::WA_ShowWithoutActivating, true);
+  setWindowTitle(QStringLiteral("Luna latency"));
+
+  text_ = new QLabel(this);
+  text_->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+  text_->setStyleSheet("color: white;");
+  text_->setTextInteractionFlags(Qt::TextSelectableByMouse);
+
+  auto* layout = new QVBoxLayout(this);
+  layout->setContentsMargins(10, 8, 10, 8);
+  layout->addWidget(text_);
+
+  timer_ = new QTimer(this);
+  timer_->setInterval(kRefreshMs);
+  connect(timer_, &QTimer::timeout, this, &StatsPanel::refresh);
+}
+
+void StatsPanel::refresh() {
+  text_->setText(LatencyTrace::instance().summary());
+  adjustSize();
+}
+
+void StatsPanel::showEvent(QShowEvent* e) {
+  refresh();
+  timer_->start();
+  QWidget::showEvent(e);
+}
+
+void StatsPanel::hideEvent(QHideEvent* e) {
+  timer_->stop();
+  QWidget::hideEvent(e);
+}
+
+void StatsPanel::paintEvent(QPaintEvent*) {
+  QPainter p(this);
+  p.setRenderHint(QPainter::Antialiasing, true);
+  p.setPen(Qt::NoPen);
+  p.setBrush(QColor(0, 0, 0, 170));
+  p.drawRoundedRect(rect(), 8, 8);
+}
@@ -0,0 +1,28 @@
+// StatsPanel.h
+
+/*
+  Small always-on-top panel with per-stage latency p50/p95 (LatencyTrace)
+*/
+
+#pragma once
+#include <QWidget>
+
+class QLabel;
+class QTimer;
+
+class StatsPanel : public QWidget {
+  Q_OBJECT
+public:
+  explicit StatsPanel(QWidget* parent=nullptr);
+
+  void refresh();
+
+protected:
+  void showEvent(QShowEvent*) override;
+  void hideEvent(QHideEvent*) override;
+  void paintEvent(QPaintEvent*) override;
+
+private:
+  QLabel* text_  = nullptr;
+  QTimer* timer_ = nullptr;
+};
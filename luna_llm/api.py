@@ -1,160 +1,436 @@
-#!/usr/bin/env python3
-import sys, torch, unicodedata
-from threading import Thread
-from fastapi import FastAPI
-from pydantic import BaseModel
-from transformers import (
-    AutoTokenizer, AutoModelForCausalLM,
-    BitsAndBytesConfig, TextIteratorStreamer
-)
-from peft import PeftModel
-import uvicorn
-
-# ------------ Config ------------
-BASE_MODEL = "Qwen/Qwen3-8B"
-ADAPTER_DIR = "qwen3-luna-qlora"   # change to your adapter path
-SYSTEM_PROMPT = "あなたは【桜小路ルナ】として話してください。台詞は日本語で、原作の表記（「…」）を守ります。"
-
-# ------------ Model Load ------------
-def ensure_chat_template(tok):
-    if tok.chat_template and tok.chat_template.strip():
-        return tok
-    tok.chat_template = r"""
-{% for message in messages %}
-{% if message['role'] == 'system' -%}
-<|im_start|>system
-{{ message['content'] }}<|im_end|>
-{% elif message['role'] == 'user' -%}
-<|im_start|>user
-{{ message['content'] }}<|im_end|>
-{% elif message['role'] == 'assistant' -%}
-<|im_start|>assistant
-{% generation %}{{ message['content'] }}{% endgeneration %}<|im_end|>
-{% endif %}
-{% endfor %}
-{% if add_generation_prompt -%}
-<|im_start|>assistant
-{% endif -%}
-""".strip() + "\n"
-    return tok
-
-def load_model_and_tokenizer(base_id, adapter_dir, load_in_4bit=True):
-    tok = AutoTokenizer.from_pretrained(base_id, trust_remote_code=True, use_fast=False)
-    tok = ensure_chat_template(tok)
-    if tok.pad_token is None:
-        tok.pad_token = tok.eos_token
-
-    if load_in_4bit:
-        bnb = BitsAndBytesConfig(
-            load_in_4bit=True,
-            bnb_4bit_quant_type="nf4",
-            bnb_4bit_use_double_quant=True,
-            bnb_4bit_compute_dtype=torch.bfloat16,
-        )
-        model = AutoModelForCausalLM.from_pretrained(
-            base_id,
-            device_map="auto",
-            torch_dtype=torch.bfloat16,
-            attn_implementation="sdpa",
-            quantization_config=bnb,
-            trust_remote_code=True,
-        )
-    else:
-        model = AutoModelForCausalLM.from_pretrained(
-            base_id,
-            device_map="auto",
-            torch_dtype=torch.float16,
-            attn_implementation="sdpa",
-            trust_remote_code=True,
-        )
-
-    model = PeftModel.from_pretrained(model, adapter_dir)
-    model.eval()
-    return model, tok
-
-def format_inputs(tokenizer, messages):
-    return tokenizer.apply_chat_template(
-        messages, add_generation_prompt=True, tokenize=True,
-        return_tensors="pt"
-    )
-
-print("Loading model…", file=sys.stderr)
-model, tok = load_model_and_tokenizer(BASE_MODEL, ADAPTER_DIR, load_in_4bit=True)
-
-# ------------ API Server ------------
-app = FastAPI()
-
-class ChatRequest(BaseModel):
-    user: str
-
-class ChatResponse(BaseModel):
-    emotion: str
-    sentence: str
-
-@app.post("/chat", response_model=ChatResponse)
-def chat(req: ChatRequest):
-    # conversation: system + user
-    messages = [
-        {"role": "system", "content": SYSTEM_PROMPT},
-        {"role": "user", "content": req.user}
-    ]
-    input_ids = format_inputs(tok, messages).to(model.device)
-
-    eos_id = tok.convert_tokens_to_ids("<|im_end|>")
-    gen_kwargs = dict(
-        max_new_tokens=128,
-        do_sample=True,
-        temperature=0.3,
-        top_p=0.9,
-        repetition_penalty=1.1,
-        eos_token_id=[tok.eos_token_id, eos_id],
-        pad_token_id=tok.pad_token_id,
-    )
-
-    streamer = TextIteratorStreamer(tok, skip_special_tokens=True, skip_prompt=True)
-    th = Thread(target=model.generate, kwargs={
-        "inputs": input_ids,
-        "streamer": streamer,
-        **{k:v for k,v in gen_kwargs.items() if v is not None}
-    })
-    th.start()
-
-    buf = []
-    newline_count = 0
-    for piece in streamer:
-        # count newlines in this piece and keep only up to the 2nd newline
-        if newline_count < 2 and "\n" in piece:
-            parts = piece.split("\n")
-            for i, part in enumerate(parts):
-                if i < len(parts) - 1:            # this sub-part ends with a newline
-                    buf.append(part + "\n")
-                    newline_count += 1
-                    if newline_count >= 2:
-                        break
-                else:
-                    if newline_count < 2:
-                        buf.append(part)          # last fragment (no newline)
-            if newline_count >= 2:
-                break
-        else:
-            buf.append(piece)
-
-    # drain so the background thread can finish cleanly
-    for _ in streamer:
-        pass
-
-    text = "".join(buf).rstrip() + "\n"           # ensure final newline
-
-
-    # ---- Split into emotion line + one sentence ----
-    lines = [ln for ln in text.split("\n") if ln.strip()]
-    emotion, sentence = "", ""
-    if len(lines) >= 1:
-        emotion = lines[0]
-    if len(lines) >= 2:
-        sentence = lines[1]
-
-    return ChatResponse(emotion=emotion, sentence=sentence)
-
-if __name__ == "__main__":
-    uvicorn.run(app, host="0.0.0.0", port=8000)
+#!/usr/bin/env python3
+import os, sys, copy, json, torch, unicodedata
+from urllib.parse import quote
+from collections import OrderedDict
+from threading import Thread, Event, Lock
+from typing import Optional
+from fastapi import FastAPI
+from fastapi.responses import StreamingResponse
+from pydantic import BaseModel
+from transformers import (
+    AutoTokenizer, AutoModelForCausalLM,
+    BitsAndBytesConfig, TextIteratorStreamer,
+    StoppingCriteria, StoppingCriteriaList, DynamicCache
+)
+from peft import PeftModel
+import uvicorn
+
+# ------------ Config ------------
+BASE_MODEL = "Qwen/Qwen3-8B"
+ADAPTER_DIR = "qwen3-luna-qlora"   # change to your adapter path
+SYSTEM_PROMPT = "あなたは【桜小路ルナ】として話してください。台詞は日本語で、原作の表記（「…」）を守ります。"
+
+# sessions: KV cache of each conversation kept on the GPU (LRU under this cap;
+# an evicted session keeps its text history and is re-prefilled once)
+KV_CACHE_MB     = int(os.environ.get("LUNA_KV_CACHE_MB", "1024"))
+MAX_SESSIONS    = int(os.environ.get("LUNA_MAX_SESSIONS", "64"))     # history text kept
+MAX_PROMPT_TOKS = int(os.environ.get("LUNA_MAX_PROMPT_TOKENS", "3072"))  # oldest turns dropped
+SESSION_WAIT_S  = 5.0   # a superseded reply still holding the session: go without its cache
+
+# ------------ Model Load ------------
+def ensure_chat_template(tok):
+    if tok.chat_template and tok.chat_template.strip():
+        return tok
+    tok.chat_template = r"""
+{% for message in messages %}
+{% if message['role'] == 'system' -%}
+<|im_start|>system
+{{ message['content'] }}<|im_end|>
+{% elif message['role'] == 'user' -%}
+<|im_start|>user
+{{ message['content'] }}<|im_end|>
+{% elif message['role'] == 'assistant' -%}
+<|im_start|>assistant
+{% generation %}{{ message['content'] }}{% endgeneration %}<|im_end|>
+{% endif %}
+{% endfor %}
+{% if add_generation_prompt -%}
+<|im_start|>assistant
+{% endif -%}
+""".strip() + "\n"
+    return tok
+
+def load_model_and_tokenizer(base_id, adapter_dir, load_in_4bit=True):
+    tok = AutoTokenizer.from_pretrained(base_id, trust_remote_code=True, use_fast=False)
+    tok = ensure_chat_template(tok)
+    if tok.pad_token is None:
+        tok.pad_token = tok.eos_token
+
+    if load_in_4bit:
+        bnb = BitsAndBytesConfig(
+            load_in_4bit=True,
+            bnb_4bit_quant_type="nf4",
+            bnb_4bit_use_double_quant=True,
+            bnb_4bit_compute_dtype=torch.bfloat16,
+        )
+        model = AutoModelForCausalLM.from_pretrained(
+            base_id,
+            device_map="auto",
+            torch_dtype=torch.bfloat16,
+            attn_implementation="sdpa",
+            quantization_config=bnb,
+            trust_remote_code=True,
+        )
+    else:
+        model = AutoModelForCausalLM.from_pretrained(
+            base_id,
+            device_map="auto",
+            torch_dtype=torch.float16,
+            attn_implementation="sdpa",
+            trust_remote_code=True,
+        )
+
+    model = PeftModel.from_pretrained(model, adapter_dir)
+    model.eval()
+    return model, tok
+
+def chat_ids(tokenizer, messages, add_generation_prompt):
+    ids = tokenizer.apply_chat_template(messages, add_generation_prompt=add_generation_prompt,
+                                        tokenize=True)
+    if isinstance(ids, dict) or hasattr(ids, "keys"):     # newer transformers: BatchEncoding
+        ids = ids["input_ids"]
+    return list(ids)
+
+def format_inputs(tokenizer, messages):
+    return tokenizer.apply_chat_template(
+        messages, add_generation_prompt=True, tokenize=True,
+        return_tensors="pt"
+    )
+
+print("Loading model…", file=sys.stderr)
+model, tok = load_model_and_tokenizer(BASE_MODEL, ADAPTER_DIR, load_in_4bit=True)
+
+# ------------ API Server ------------
+app = FastAPI()
+
+class CancelCriteria(StoppingCriteria):
+    """Stops generate() once the consumer of the stream has gone away."""
+    def __init__(self, event):
+        self.event = event
+
+    def __call__(self, input_ids, scores, **kwargs):
+        return self.event.is_set()
+
+class ReplyDoneCriteria(StoppingCriteria):
+    """Stops generate() once the reply is complete: the emotion line plus the
+    sentence, i.e. the 2nd newline, or the 」 that closes the sentence's 「.
+    Only the newest token is decoded per step."""
+    def __init__(self, tokenizer, prompt_len):
+        self.tok = tokenizer
+        self.prompt_len = prompt_len
+        self.newlines = 0
+        self.depth = 0          # open 「 on the sentence line
+        self.closed = False     # a 「…」 has been closed there
+
+    def __call__(self, input_ids, scores, **kwargs):
+        if input_ids.shape[1] <= self.prompt_len:
+            return False
+        text = self.tok.decode(input_ids[0, -1:], skip_special_tokens=True)
+        for ch in text:
+            if ch == "\n":
+                self.newlines += 1
+            elif self.newlines == 1:
+                if ch == "「":
+                    self.depth += 1
+                elif ch == "」" and self.depth > 0:
+                    self.depth -= 1
+                    self.closed = self.depth == 0
+        return self.newlines >= 2 or (self.closed and self.depth == 0)
+
+class ChatRequest(BaseModel):
+    user: str
+    session: Optional[str] = None   # none: stateless (system prompt + this message)
+    turn: Optional[int] = None      # replies the client has seen in this session
+    early_emotion: bool = False     # /chat: emotion in an X-Emotion header as soon as line 1 is done
+
+# ------------ KV cache reuse ------------
+#
+# Every prompt starts with the same system block, and a session's next prompt
+# starts with everything of the previous one (system, earlier turns, the reply
+# as generated). We keep the DynamicCache that generate() filled together with
+# the token ids it holds, crop it to the longest common prefix with the new
+# prompt, and let generate() prefill only the rest.
+
+def cache_bytes(cache):
+    if cache is None:
+        return 0
+    layers = getattr(cache, "layers", None)          # transformers >= 4.56
+    if layers is not None:
+        tensors = [t for l in layers for t in (getattr(l, "keys", None), getattr(l, "values", None))]
+    else:
+        tensors = list(cache.key_cache) + list(cache.value_cache)
+    return sum(t.numel() * t.element_size() for t in tensors if t is not None and hasattr(t, "numel"))
+
+def common_prefix(a, b):
+    n = min(len(a), len(b))
+    i = 0
+    while i < n and a[i] == b[i]:
+        i += 1
+    return i
+
+class Session:
+    def __init__(self):
+        self.history = []      # [{"role": "user"|"assistant", "content": …}]
+        self.cache = None      # DynamicCache, or None (evicted / new)
+        self.ids = []          # token ids the cache holds (positions 0..len-1)
+        self.lock = Lock()     # one generate() per session at a time
+        self.cancel = None     # Event of the generate() holding the lock
+
+class SessionStore:
+    def __init__(self):
+        self.lock = Lock()
+        self.sessions = OrderedDict()   # LRU: oldest first
+        self.prefix_ids = []
+        self.prefix_cache = None
+
+    def warm_prefix(self):
+        """Prefill the system block once; new and stateless prompts start from a copy."""
+        ids = chat_ids(tok, [{"role": "system", "content": SYSTEM_PROMPT}], False)
+        cache = DynamicCache()
+        with torch.no_grad():
+            model(input_ids=torch.tensor([ids], device=model.device),
+                  past_key_values=cache, use_cache=True)
+        self.prefix_ids, self.prefix_cache = list(ids), cache
+        print(f"System prefix cached: {len(ids)} tokens", file=sys.stderr)
+
+    def get(self, sid):
+        with self.lock:
+            s = self.sessions.get(sid)
+            if s is None:
+                s = self.sessions[sid] = Session()
+                while len(self.sessions) > MAX_SESSIONS:
+                    self.sessions.popitem(last=False)
+            self.sessions.move_to_end(sid)
+            return s
+
+    def evict(self, keep):
+        """Drop KV caches, least recently used first, until under KV_CACHE_MB."""
+        with self.lock:
+            cap = KV_CACHE_MB * 1024 * 1024
+            total = sum(cache_bytes(s.cache) for s in self.sessions.values())
+            for s in list(self.sessions.values()):
+                if total <= cap:
+                    break
+                if s is keep or s.cache is None or s.lock.locked():
+                    continue
+                total -= cache_bytes(s.cache)
+                s.cache, s.ids = None, []
+
+    def stats(self):
+        with self.lock:
+            return {
+                "sessions": len(self.sessions),
+                "kv_mb": round(sum(cache_bytes(s.cache) for s in self.sessions.values()) / 2**20, 1),
+            }
+
+    def start_cache(self, session, ids):
+        """A cache holding a prefix of `ids` (at least one token left to prefill)."""
+        cache, held = (session.cache, session.ids) if session and session.cache is not None else (None, [])
+        if cache is None and self.prefix_cache is not None:
+            cache, held = copy.deepcopy(self.prefix_cache), self.prefix_ids
+        if cache is None:
+            return DynamicCache(), 0
+        n = min(common_prefix(held, ids), cache.get_seq_length(), len(ids) - 1)
+        if n <= 0:
+            return DynamicCache(), 0
+        cache.crop(n)
+        return cache, n
+
+store = SessionStore()
+store.warm_prefix()
+
+class ChatResponse(BaseModel):
+    emotion: str
+    sentence: str
+
+def build_prompt(history, user):
+    """Token ids for system + history + user; oldest turns go first if too long."""
+    while True:
+        messages = [{"role": "system", "content": SYSTEM_PROMPT}] + history + \
+                   [{"role": "user", "content": user}]
+        ids = chat_ids(tok, messages, True)
+        if len(ids) <= MAX_PROMPT_TOKS or not history:
+            return ids, history
+        history = history[2:]
+
+def generate_pieces(user, session_id=None, turn=None):
+    """Yield decoded text pieces as the model produces them, up to the 2nd newline."""
+    session = store.get(session_id) if session_id else None
+    history = []
+    if session is not None:
+        if session.cancel is not None:
+            session.cancel.set()          # superseded: the older reply stops at its next token
+        if not session.lock.acquire(timeout=SESSION_WAIT_S):
+            # still held (a stream nobody reads any more): this turn goes without
+            # the cache and isn't recorded
+            history, session = list(session.history), None
+    cancel = Event()   # set when we stop reading: reply complete or client gone
+    try:
+        if session is not None:
+            session.cancel = cancel
+            # the client didn't see the last reply(s) (cancelled): forget them too
+            if turn is not None and 0 <= turn < len(session.history) // 2:
+                session.history = session.history[:turn * 2]
+            history = session.history
+        ids, history = build_prompt(history, user)
+        if session is not None:
+            session.history = history
+        cache, reused = store.start_cache(session, ids)
+        if session is not None:
+            session.cache, session.ids = cache, ids[:reused]   # what it holds right now
+        print(f"prefill {len(ids) - reused}/{len(ids)} tokens"
+              + (f" (session {session_id[:8]}, turn {len(history) // 2})" if session else ""),
+              file=sys.stderr)
+
+        input_ids = torch.tensor([ids], device=model.device)
+        eos_id = tok.convert_tokens_to_ids("<|im_end|>")
+        gen_kwargs = dict(
+            max_new_tokens=128,
+            do_sample=True,
+            temperature=0.3,
+            top_p=0.9,
+            repetition_penalty=1.1,
+            eos_token_id=[tok.eos_token_id, eos_id],
+            pad_token_id=tok.pad_token_id,
+        )
+
+        streamer = TextIteratorStreamer(tok, skip_special_tokens=True, skip_prompt=True)
+        result = {}
+        def run():
+            try:
+                result["seq"] = model.generate(**kwargs)
+            except Exception as e:
+                print(f"generate failed: {e}", file=sys.stderr)
+                streamer.end()                       # don't leave the reader waiting
+        kwargs = {
+            "inputs": input_ids,
+            "attention_mask": torch.ones_like(input_ids),
+            "past_key_values": cache,
+            "streamer": streamer,
+            "stopping_criteria": StoppingCriteriaList([
+                CancelCriteria(cancel), ReplyDoneCriteria(tok, len(ids))]),
+            **{k:v for k,v in gen_kwargs.items() if v is not None}
+        }
+        th = Thread(target=run)
+        th.start()
+
+        newline_count = 0
+        reply = []
+        complete = False
+        try:
+            for piece in streamer:
+                # count newlines in this piece and keep only up to the 2nd newline
+                if newline_count < 2 and "\n" in piece:
+                    parts = piece.split("\n")
+                    for i, part in enumerate(parts):
+                        if i < len(parts) - 1:            # this sub-part ends with a newline
+                            reply.append(part + "\n")
+                            yield part + "\n"
+                            newline_count += 1
+                            if newline_count >= 2:
+                                break
+                        else:
+                            if newline_count < 2 and part:
+                                reply.append(part)
+                                yield part                # last fragment (no newline)
+                    if newline_count >= 2:
+                        break
+                else:
+                    reply.append(piece)
+                    yield piece
+            complete = not cancel.is_set()     # set by a newer request: superseded
+        finally:
+            # generate() normally stopped itself (ReplyDoneCriteria); this is for
+            # the client going away mid-reply. Drain so the thread ends cleanly
+            cancel.set()
+            for _ in streamer:
+                pass
+            th.join()
+            if session is not None:
+                seq = result.get("seq")
+                if seq is not None:
+                    # the cache holds every token but the last sampled one
+                    held = seq[0].tolist()
+                    session.ids = held[:cache.get_seq_length()]
+                else:
+                    session.cache, session.ids = None, []   # half-updated: don't trust it
+                if complete:
+                    text = "".join(reply).strip()
+                    session.history = session.history + [
+                        {"role": "user", "content": user},
+                        {"role": "assistant", "content": text},
+                    ]
+    finally:
+        if session is not None:
+            session.cancel = None
+            session.lock.release()
+            store.evict(keep=session)
+
+def split_reply(text):
+    # ---- Split into emotion line + one sentence ----
+    lines = [ln for ln in text.split("\n") if ln.strip()]
+    emotion, sentence = "", ""
+    if len(lines) >= 1:
+        emotion = lines[0]
+    if len(lines) >= 2:
+        sentence = lines[1]
+    return emotion, sentence
+
+@app.get("/health")
+def health():
+    return {"ok": True, **store.stats()}
+
+@app.post("/chat", response_model=ChatResponse)
+def chat(req: ChatRequest):
+    pieces = generate_pieces(req.user, req.session, req.turn)
+    if not req.early_emotion:
+        text = "".join(pieces).rstrip() + "\n"   # ensure final newline
+        emotion, sentence = split_reply(text)
+        return ChatResponse(emotion=emotion, sentence=sentence)
+
+    # same body, but the response starts once line 1 is known: the emotion
+    # goes out in the headers while the sentence is still being generated
+    head = ""
+    for piece in pieces:
+        head += piece
+        if "\n" in head.lstrip("\n"):
+            break
+    emotion_now = head.lstrip("\n").partition("\n")[0].strip()
+
+    def body():
+        text = (head + "".join(pieces)).rstrip() + "\n"
+        emotion, sentence = split_reply(text)
+        yield json.dumps({"emotion": emotion, "sentence": sentence}, ensure_ascii=False)
+
+    return StreamingResponse(body(), media_type="application/json",
+                             headers={"X-Emotion": quote(emotion_now)})
+
+@app.post("/chat_stream")
+def chat_stream(req: ChatRequest):
+    """Same reply as /chat, as NDJSON events while it is generated:
+         {"type":"emotion","emotion":"<E:smile>"}       first line complete
+         {"type":"delta","text":"「…"}                   sentence grows
+         {"type":"done","emotion":…,"sentence":…}       final (same as /chat)
+    """
+    def events():
+        buf = ""
+        sent_emotion = False
+        for piece in generate_pieces(req.user, req.session, req.turn):
+            buf += piece
+            if not sent_emotion:
+                if "\n" not in buf.lstrip("\n"):
+                    continue
+                head, _, rest = buf.lstrip("\n").partition("\n")
+                sent_emotion = True
+                yield json.dumps({"type": "emotion", "emotion": head.strip()}, ensure_ascii=False) + "\n"
+                piece = rest
+            text = piece.rstrip("\n") if piece.endswith("\n") else piece
+            if text:
+                yield json.dumps({"type": "delta", "text": text}, ensure_ascii=False) + "\n"
+        emotion, sentence = split_reply(buf.rstrip() + "\n")
+        yield json.dumps({"type": "done", "emotion": emotion, "sentence": sentence}, ensure_ascii=False) + "\n"
+
+    return StreamingResponse(events(), media_type="application/x-ndjson")
+
+if __name__ == "__main__":
+    uvicorn.run(app, host="0.0.0.0", port=8000)